@@ -0,0 +1,142 @@
+#include "RayQuery.h"
+#include "Scene.h"
+#include "SceneBuilder.h"
+#include "Sphere.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+//Rays one pool index covers, big enough that dispatch costs nothing next to traversal
+static constexpr size_t QUERY_CHUNK_SIZE = 256;
+
+struct RayQueryScene::Impl {
+	SceneBuilder builder;
+	MaterialHandle material; //Every object shares one, queries never shade
+	std::shared_ptr<Scene> scene; //Null until the first commit
+	bool moved = false;
+
+	Impl() :
+		material(builder.addMaterial(Material{ Vec3f{ 0, 0, 0 } }))
+	{}
+
+	SceneBuilder& getBuilder() {
+		if (scene)
+			throw "Objects can only be added before the first commit";
+		return builder;
+	}
+
+	const Scene& getScene() const {
+		if (!scene)
+			throw "Ray queries need a committed scene";
+		return *scene;
+	}
+};
+
+static Transform toTransform(const float* toWorld) {
+	return toWorld != nullptr ? Transform(Mat44f(toWorld)) : Transform();
+}
+
+static Ray makeRay(const RayBatch& rays, size_t i) {
+	Ray r{ { rays.originX[i], rays.originY[i], rays.originZ[i] }, { rays.directionX[i], rays.directionY[i], rays.directionZ[i] } };
+	if (rays.tMin != nullptr)
+		r.tMin = rays.tMin[i];
+	if (rays.tMax != nullptr)
+		r.tMax = rays.tMax[i];
+	return r;
+}
+
+//Calls func(i) for every ray, QUERY_CHUNK_SIZE rays per pool index
+template<typename F>
+static void forEachRay(size_t count, const F& func) {
+	size_t numChunks = (count + QUERY_CHUNK_SIZE - 1) / QUERY_CHUNK_SIZE;
+	getThreadPool().parallelFor(numChunks, [&](size_t chunk, size_t) {
+		size_t end = std::min(count, (chunk + 1) * QUERY_CHUNK_SIZE);
+		for (size_t i = chunk * QUERY_CHUNK_SIZE; i < end; i++)
+			func(i);
+	});
+}
+
+RayQueryScene::RayQueryScene() :
+	impl(std::make_unique<Impl>())
+{}
+
+RayQueryScene::RayQueryScene(RayQueryScene&& other) = default;
+
+RayQueryScene& RayQueryScene::operator=(RayQueryScene&& other) = default;
+
+RayQueryScene::~RayQueryScene() = default;
+
+uint32_t RayQueryScene::addSphere(float centerX, float centerY, float centerZ, float radius, const float* toWorld) {
+	SceneBuilder& builder = impl->getBuilder();
+	ShapeHandle shape = builder.addShape<Sphere>(Poi3f{ centerX, centerY, centerZ }, radius);
+	return builder.addObject(toTransform(toWorld), shape, impl->material).index;
+}
+
+uint32_t RayQueryScene::addTriangleMesh(const float* positions, size_t numVertices, const uint32_t* indices, size_t numTriangles,
+	const float* toWorld) {
+	SceneBuilder& builder = impl->getBuilder();
+	std::vector<Poi3f> verts(numVertices);
+	for (size_t i = 0; i < numVertices; i++)
+		verts[i] = Poi3f{ positions[3 * i], positions[3 * i + 1], positions[3 * i + 2] };
+	std::vector<int> indexes(indices, indices + 3 * numTriangles);
+	ShapeHandle shape = builder.addTriangleMesh(verts.data(), (int)numVertices, indexes.data(), (int)numTriangles);
+	return builder.addObject(toTransform(toWorld), shape, impl->material).index;
+}
+
+void RayQueryScene::setTransform(uint32_t objectId, const float* toWorld) {
+	if (!impl->scene)
+		throw "Objects can only be moved after the first commit";
+	if (objectId >= impl->scene->getNumObjects())
+		throw "No object with that id";
+	impl->scene->getObject(objectId).setTransform(toTransform(toWorld));
+	impl->moved = true;
+}
+
+void RayQueryScene::commit() {
+	if (!impl->scene) {
+		impl->scene = impl->builder.build();
+	} else if (impl->moved) {
+		impl->scene->update();
+	}
+	impl->moved = false;
+}
+
+size_t RayQueryScene::getNumObjects() const {
+	return impl->scene ? impl->scene->getNumObjects() : 0;
+}
+
+void RayQueryScene::intersect(const RayBatch& rays, const HitBatch& hits) const {
+	const Scene& scene = impl->getScene();
+	bool wantNormals = hits.normalX != nullptr && hits.normalY != nullptr && hits.normalZ != nullptr;
+	forEachRay(rays.count, [&](size_t i) {
+		Ray r = makeRay(rays, i);
+		Hit hit;
+		if (!scene.intersect(r, hit)) {
+			hits.t[i] = std::numeric_limits<float>::infinity();
+			hits.objectId[i] = RAY_QUERY_MISS;
+			hits.primitiveId[i] = 0;
+			if (wantNormals)
+				hits.normalX[i] = hits.normalY[i] = hits.normalZ[i] = 0;
+			return;
+		}
+		hits.t[i] = r.tMax; //Hits shorten the ray to themselves, in world space
+		hits.objectId[i] = (uint32_t)(hit.object - &impl->scene->getObject(0));
+		hits.primitiveId[i] = hit.primId;
+		if (wantNormals) {
+			Intersection insect;
+			scene.finalize(r, hit, insect);
+			Vec3f n = normalize(Vec3f(insect.n));
+			hits.normalX[i] = n.x;
+			hits.normalY[i] = n.y;
+			hits.normalZ[i] = n.z;
+		}
+	});
+}
+
+void RayQueryScene::occluded(const RayBatch& rays, uint8_t* occluded) const {
+	const Scene& scene = impl->getScene();
+	forEachRay(rays.count, [&](size_t i) {
+		occluded[i] = scene.occluded(makeRay(rays, i)) ? 1 : 0;
+	});
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+//Batched ray casts against SimpleTracer's scene and BVH, for clients that want visibility or collision queries without
+//cameras, materials or images. Only standard headers appear here, so the renderer's internals can change underneath
+//without breaking code built against this file. Bumped whenever this header changes incompatibly
+static constexpr int RAY_QUERY_API_VERSION = 1;
+
+//objectId of rays that hit nothing
+static constexpr uint32_t RAY_QUERY_MISS = 0xffffffff;
+
+//Rays as structure of arrays, element i of every array belongs to ray i. Directions need not be unit length,
+//t is measured in multiples of them
+struct RayBatch {
+	const float* originX;
+	const float* originY;
+	const float* originZ;
+	const float* directionX;
+	const float* directionY;
+	const float* directionZ;
+	const float* tMin; //Null for 0 on every ray
+	const float* tMax; //Null for unbounded
+	size_t count;
+};
+
+//Where a batch's results go, every array holds at least as many elements as the batch has rays
+struct HitBatch {
+	float* t; //Infinity for misses
+	uint32_t* objectId; //In the order objects were added, RAY_QUERY_MISS for misses
+	uint32_t* primitiveId; //Triangle within a mesh, 0 for spheres
+
+	//Unit geometric normal in world space, outward on spheres and by counter clockwise winding on triangles.
+	//Null to skip computing normals
+	float* normalX;
+	float* normalY;
+	float* normalZ;
+};
+
+//Spheres and triangle meshes, each placed by an optional row major 4x4 toWorld matrix. Objects are added, then
+//commit builds the hierarchy; after that objects can be moved and committed again, which refits instead of rebuilding
+struct RayQueryScene {
+private:
+	struct Impl;
+	std::unique_ptr<Impl> impl;
+public:
+	RayQueryScene();
+
+	RayQueryScene(RayQueryScene&& other);
+
+	RayQueryScene& operator=(RayQueryScene&& other);
+
+	~RayQueryScene();
+
+	//Returns the new object's id. Adding after the first commit throws
+	uint32_t addSphere(float centerX, float centerY, float centerZ, float radius, const float* toWorld = nullptr);
+
+	//positions holds numVertices xyz triples, indices three per triangle. Both are copied
+	uint32_t addTriangleMesh(const float* positions, size_t numVertices, const uint32_t* indices, size_t numTriangles,
+		const float* toWorld = nullptr);
+
+	//Only after the first commit, shows up in queries after the next one
+	void setTransform(uint32_t objectId, const float* toWorld);
+
+	void commit();
+
+	size_t getNumObjects() const;
+
+	//Closest hit of every ray, split across the process's worker threads. Queries need a commit first and must
+	//not run concurrently with each other, the thread pool takes one batch at a time
+	void intersect(const RayBatch& rays, const HitBatch& hits) const;
+
+	//occluded[i] is 1 if anything lies within ray i's range, 0 otherwise. Cheaper than intersect, stops at any hit
+	void occluded(const RayBatch& rays, uint8_t* occluded) const;
+};
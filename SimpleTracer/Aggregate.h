@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Hittable.h"
+#include "Object.h"
 #include <vector>
 
 struct Aggregate : public Hittable {
@@ -11,12 +12,30 @@ public:
 		hittables(std::move(hittables))
 	{}
 
-	virtual bool intersect(const Ray& r, Intersection* insect = nullptr) const {
-		bool hit = false;
-		for (std::shared_ptr<Hittable> h : hittables) {
-			hit = hit || h->intersect(r, insect);
+	using Hittable::intersect;
+
+	virtual bool intersect(const Ray& r, Hit& hit) const {
+		bool found = false;
+		for (const std::shared_ptr<Hittable>& h : hittables) {
+			if (h->intersect(r, hit))
+				found = true;
 		}
 
-		return hit;
+		return found;
+	}
+
+	using Hittable::occluded;
+
+	virtual bool occluded(const Ray& r) const {
+		for (const std::shared_ptr<Hittable>& h : hittables) {
+			if (h->occluded(r))
+				return true;
+		}
+		return false;
+	}
+
+	//Whatever was hit is an Object somewhere down the tree, and it knows how to finish up
+	virtual void finalize(const Ray& r, const Hit& hit, Intersection& insect) const {
+		hit.object->finalize(r, hit, insect);
 	}
-};
\ No newline at end of file
+};
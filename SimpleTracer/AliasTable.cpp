@@ -0,0 +1,51 @@
+#include "AliasTable.h"
+#include <algorithm>
+
+static constexpr float ONE_MINUS_EPSILON = 0.99999994f;
+
+AliasTable::AliasTable(const std::vector<float>& weights) :
+	bins(weights.size()),
+	pmf(weights.size())
+{
+	double sum = 0;
+	for (float w : weights)
+		sum += w;
+	size_t n = weights.size();
+	for (size_t i = 0; i < n; i++)
+		pmf[i] = sum > 0 ? (float)(weights[i] / sum) : 1.0f / n; //All zero falls back to uniform
+
+	//Vose's construction: bins under the average get topped up from one over it
+	std::vector<double> scaled(n);
+	std::vector<uint32_t> small, large;
+	for (size_t i = 0; i < n; i++) {
+		scaled[i] = (double)pmf[i] * n;
+		(scaled[i] < 1 ? small : large).push_back((uint32_t)i);
+	}
+	while (!small.empty() && !large.empty()) {
+		uint32_t s = small.back(), l = large.back();
+		small.pop_back();
+		bins[s] = { (float)scaled[s], l };
+		scaled[l] -= 1 - scaled[s];
+		if (scaled[l] < 1) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	for (uint32_t i : large) //Whatever rounding left over is full
+		bins[i] = { 1, i };
+	for (uint32_t i : small)
+		bins[i] = { 1, i };
+}
+
+uint32_t AliasTable::sample(float& u) const {
+	float scaled = u * bins.size();
+	uint32_t i = std::min((uint32_t)scaled, (uint32_t)bins.size() - 1);
+	float fraction = std::min(scaled - i, ONE_MINUS_EPSILON);
+	const Bin& bin = bins[i];
+	if (fraction < bin.accept) {
+		u = std::min(fraction / bin.accept, ONE_MINUS_EPSILON);
+		return i;
+	}
+	u = std::min((fraction - bin.accept) / (1 - bin.accept), ONE_MINUS_EPSILON);
+	return bin.alias;
+}
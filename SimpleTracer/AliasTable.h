@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Walker's alias method: picks index i with probability weights[i] / sum in constant time
+struct AliasTable {
+private:
+	struct Bin {
+		float accept; //Odds of keeping this bin's own index rather than taking alias
+		uint32_t alias;
+	};
+
+	std::vector<Bin> bins;
+	std::vector<float> pmf;
+public:
+	AliasTable() = default;
+
+	//Weights must be non-negative with a positive sum
+	explicit AliasTable(const std::vector<float>& weights);
+
+	//Picks an index with u in [0, 1), and leaves u remapped to a fresh uniform value in [0, 1) for further use
+	uint32_t sample(float& u) const;
+
+	float getPmf(uint32_t i) const {
+		return pmf[i];
+	}
+
+	size_t size() const {
+		return pmf.size();
+	}
+};
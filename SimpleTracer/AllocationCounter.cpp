@@ -0,0 +1,74 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<int> activeCounters{ 0 };
+static std::atomic<uint64_t> numAllocations{ 0 };
+
+static void* allocate(size_t size) {
+	if (activeCounters.load(std::memory_order_relaxed) > 0)
+		numAllocations.fetch_add(1, std::memory_order_relaxed);
+	return std::malloc(size > 0 ? size : 1);
+}
+
+AllocationCounter::AllocationCounter() {
+	activeCounters++;
+	start = numAllocations.load();
+}
+
+AllocationCounter::~AllocationCounter() {
+	activeCounters--;
+}
+
+uint64_t AllocationCounter::getCount() const {
+	return numAllocations.load() - start;
+}
+
+//Over aligned new keeps the library's own pair of operators and goes uncounted, nothing in the renderer uses it
+
+void* operator new(size_t size) {
+	void* p = allocate(size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) {
+	void* p = allocate(size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+//Counts heap allocations made through operator new by any thread while a counter is alive, via replacements of the
+//global operators in AllocationCounter.cpp. Outside a counter they cost one relaxed flag load, so the replacements
+//stay linked into every build. Meant for checking that a render loop's steady state never allocates
+struct AllocationCounter {
+private:
+	uint64_t start;
+public:
+	AllocationCounter();
+
+	AllocationCounter(const AllocationCounter&) = delete;
+
+	AllocationCounter& operator=(const AllocationCounter&) = delete;
+
+	~AllocationCounter();
+
+	//Allocations since construction
+	uint64_t getCount() const;
+};
@@ -0,0 +1,19 @@
+#include "Animation.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+void Animation::setTime(float time) {
+	getThreadPool().parallelFor(tracks.size(), [&](size_t i, size_t) {
+		scene->getObject(tracks[i].objectIndex).setTransform(tracks[i].transformAt(time));
+	});
+	scene->update();
+}
+
+void Animation::render(const Camera& camera, const Transform& camToWorld, int numFrames, float framesPerSecond,
+	const std::function<void(int frame, const Image& img)>& onFrame) {
+	for (int frame = 0; frame < numFrames; frame++) {
+		TRACE_SCOPE("Frame", "frame", frame);
+		setTime(frame / framesPerSecond);
+		onFrame(frame, camera.renderImage(camToWorld));
+	}
+}
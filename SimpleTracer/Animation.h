@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Camera.h"
+#include "Image.h"
+#include "Scene.h"
+#include "Transform.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+//Moves one object of the scene, transformAt gives its object to world transform at a time in seconds
+struct AnimationTrack {
+	size_t objectIndex;
+	std::function<Transform(float time)> transformAt;
+};
+
+//Renders a frame sequence from one scene, updating the moving objects and refitting the
+//acceleration structure between frames instead of setting the scene up again
+struct Animation {
+private:
+	std::shared_ptr<Scene> scene;
+	std::vector<AnimationTrack> tracks;
+public:
+	Animation(std::shared_ptr<Scene> scene, std::vector<AnimationTrack> tracks) :
+		scene(std::move(scene)),
+		tracks(std::move(tracks))
+	{}
+
+	//Poses every tracked object at time and updates the scene's acceleration structure
+	void setTime(float time);
+
+	//Camera has to render the same scene. onFrame is called with each frame in order
+	void render(const Camera& camera, const Transform& camToWorld, int numFrames, float framesPerSecond,
+		const std::function<void(int frame, const Image& img)>& onFrame);
+};
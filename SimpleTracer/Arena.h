@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//Stable 32 bit index into one of a scene's tables, typed so handles into different tables do not mix
+template<typename T>
+struct Handle {
+	uint32_t index;
+};
+
+//Monotonic storage with one pool per type, so objects of a type sit next to each other in memory.
+//Nothing is freed individually, everything goes when the arena does, a handful of block frees per type
+struct Arena {
+private:
+	struct PoolBase {
+		virtual ~PoolBase() {}
+	};
+
+	template<typename T>
+	struct Pool : public PoolBase {
+		struct Block {
+			T* data;
+			size_t capacity;
+			size_t used;
+		};
+		std::vector<Block> blocks;
+
+		T* allocate(size_t n) {
+			if (blocks.empty() || blocks.back().capacity - blocks.back().used < n) {
+				size_t capacity = std::max(n, std::max<size_t>(1, BLOCK_BYTES / sizeof(T)));
+				blocks.push_back({ std::allocator<T>().allocate(capacity), capacity, 0 });
+			}
+			Block& block = blocks.back();
+			T* p = block.data + block.used;
+			block.used += n;
+			return p;
+		}
+
+		~Pool() {
+			for (Block& block : blocks) {
+				if (!std::is_trivially_destructible<T>::value) {
+					for (size_t i = 0; i < block.used; i++)
+						block.data[i].~T();
+				}
+				std::allocator<T>().deallocate(block.data, block.capacity);
+			}
+		}
+	};
+
+	std::vector<std::unique_ptr<PoolBase>> pools; //Indexed by typeId
+
+	static size_t nextTypeId() {
+		static std::atomic<size_t> next{ 0 };
+		return next++;
+	}
+
+	template<typename T>
+	static size_t typeId() {
+		static const size_t id = nextTypeId();
+		return id;
+	}
+
+	template<typename T>
+	Pool<T>& pool() {
+		size_t id = typeId<T>();
+		if (pools.size() <= id)
+			pools.resize(id + 1);
+		if (!pools[id])
+			pools[id] = std::make_unique<Pool<T>>();
+		return static_cast<Pool<T>&>(*pools[id]);
+	}
+public:
+	static constexpr size_t BLOCK_BYTES = 64 * 1024;
+
+	Arena() {}
+
+	Arena(Arena&&) = default;
+
+	Arena& operator=(Arena&&) = default;
+
+	Arena(const Arena&) = delete;
+
+	Arena& operator=(const Arena&) = delete;
+
+	//The pointer stays valid for the arena's lifetime
+	template<typename T, typename... Args>
+	T* create(Args&&... args) {
+		return new (pool<T>().allocate(1)) T(std::forward<Args>(args)...);
+	}
+
+	//Contiguous, value initialised array of plain data
+	template<typename T>
+	T* createArray(size_t n) {
+		static_assert(std::is_trivially_destructible<T>::value, "Arrays are released without running destructors");
+		T* data = pool<T>().allocate(n);
+		for (size_t i = 0; i < n; i++)
+			new (data + i) T();
+		return data;
+	}
+};
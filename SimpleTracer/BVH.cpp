@@ -0,0 +1,411 @@
+#include "BVH.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+#include <algorithm>
+#include <array>
+
+struct BVH::BuildContext {
+	const std::vector<Bounds3f>& primBounds;
+	BuildMethod method;
+	std::vector<Poi3f> centroids;
+	std::vector<uint32_t> mortonCodes; //Code of the primitive at each position of primIndices, Morton builds only
+	std::vector<uint32_t> scratch; //Parallel partitions scatter through this
+};
+
+//Interior node above the task subtrees. Children are other top nodes, or ~task for a subtree built by a task
+struct BVH::TopNode {
+	Bounds3f bounds;
+	int axis;
+	int32_t children[2];
+};
+
+struct BVH::BuildTask {
+	uint32_t begin;
+	uint32_t end;
+	uint32_t base; //Where the subtree ends up in nodes
+	std::vector<BVHNode> nodes; //Depth first from 0, interior offsets relative to the subtree
+};
+
+struct Bin {
+	Bounds3f bounds;
+	uint32_t count = 0;
+};
+
+static constexpr uint32_t CHUNK_SIZE = 16 * 1024;
+static constexpr int RADIX_BITS = 10;
+static constexpr uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+
+static size_t numChunks(uint32_t begin, uint32_t end) {
+	return (end - begin + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+//Runs func(chunk, chunkBegin, chunkEnd) over [begin, end) in fixed size chunks, on the pool only when there is more than one
+template<typename F>
+static void forChunks(uint32_t begin, uint32_t end, const F& func) {
+	auto runChunk = [&](size_t c, size_t) {
+		uint32_t chunkBegin = begin + (uint32_t)c * CHUNK_SIZE;
+		func(c, chunkBegin, std::min(end, chunkBegin + CHUNK_SIZE));
+	};
+	size_t count = numChunks(begin, end);
+	if (count > 1)
+		getThreadPool().parallelFor(count, runChunk);
+	else if (count == 1)
+		runChunk(0, 0);
+}
+
+static void rangeBounds(const std::vector<Bounds3f>& primBounds, const std::vector<Poi3f>& centroids, const uint32_t* prims, uint32_t count,
+	Bounds3f& bounds, Bounds3f& centroidBounds) {
+	for (uint32_t i = 0; i < count; i++) {
+		bounds = merge(bounds, primBounds[prims[i]]);
+		centroidBounds = merge(centroidBounds, centroids[prims[i]]);
+	}
+}
+
+//Spreads the low 10 bits of v out to every third bit
+static uint32_t expandBits(uint32_t v) {
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+//p in [0, 1]^3, x ends up in the highest bit of each triple
+static uint32_t mortonCode(const Vec3f& p) {
+	auto quantize = [](float f) {
+		return std::min((uint32_t)std::max(f * RADIX_SIZE, 0.0f), RADIX_SIZE - 1);
+	};
+	return (expandBits(quantize(p.x)) << 2) | (expandBits(quantize(p.y)) << 1) | expandBits(quantize(p.z));
+}
+
+void BVH::build(const std::vector<Bounds3f>& primBounds, BuildMethod method) {
+	TRACE_SCOPE("BVH build", "primitives", (int64_t)primBounds.size());
+	CounterScope counters(PHASE_BUILD);
+	Timer timer;
+	nodes.clear();
+	refitTasks.clear();
+	topNodes.clear();
+	uint32_t n = (uint32_t)primBounds.size();
+	primIndices.resize(n);
+	if (n == 0) {
+		buildSeconds = timer.mark().count();
+		return;
+	}
+
+	BuildContext ctx{ primBounds, method, {}, {}, {} };
+	ctx.centroids.resize(n);
+	forChunks(0, n, [&](size_t, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			primIndices[i] = i;
+			ctx.centroids[i] = primBounds[i].centroid();
+		}
+	});
+	if (method == BuildMethod::Morton)
+		sortMorton(ctx);
+	else
+		ctx.scratch.resize(n);
+
+	//Enough tasks to balance uneven subtrees, each still big enough to be worth a dispatch
+	uint32_t taskSize = std::max(MIN_TASK_SIZE, n / (uint32_t)(getThreadPool().getNumThreads() * TASKS_PER_THREAD));
+	std::vector<TopNode> top;
+	std::vector<BuildTask> tasks;
+	int32_t root = buildTop(ctx, top, tasks, 0, n, taskSize);
+
+	auto runTask = [&](size_t t, size_t) {
+		BuildTask& task = tasks[t];
+		task.nodes.reserve(2 * (task.end - task.begin) / MAX_LEAF_SIZE + 1);
+		buildSubtree(ctx, task.nodes, task.begin, task.end);
+	};
+	if (tasks.size() > 1)
+		getThreadPool().parallelFor(tasks.size(), runTask);
+	else
+		runTask(0, 0);
+
+	layout(top, tasks, root);
+	auto placeTask = [&](size_t t, size_t) {
+		const BuildTask& task = tasks[t];
+		for (size_t i = 0; i < task.nodes.size(); i++) {
+			BVHNode& node = nodes[task.base + i];
+			node = task.nodes[i];
+			if (node.count == 0)
+				node.offset += task.base;
+		}
+	};
+	if (tasks.size() > 1)
+		getThreadPool().parallelFor(tasks.size(), placeTask);
+	else
+		placeTask(0, 0);
+
+	buildSeconds = timer.mark().count();
+}
+
+void BVH::sortMorton(BuildContext& ctx) {
+	uint32_t n = (uint32_t)primIndices.size();
+	size_t chunks = numChunks(0, n);
+	std::vector<Bounds3f> chunkBounds(chunks);
+	forChunks(0, n, [&](size_t c, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+			chunkBounds[c] = merge(chunkBounds[c], ctx.centroids[i]);
+	});
+	Bounds3f centroidBounds;
+	for (const Bounds3f& b : chunkBounds)
+		centroidBounds = merge(centroidBounds, b);
+
+	//Code in the high half, primitive in the low half
+	std::vector<uint64_t> keys(n), sorted(n);
+	forChunks(0, n, [&](size_t, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+			keys[i] = (uint64_t)mortonCode(centroidBounds.offset(ctx.centroids[i])) << 32 | i;
+	});
+
+	//Least significant digit radix sort, chunks histogram and scatter their own keys in parallel
+	std::vector<uint32_t> offsets(chunks * RADIX_SIZE);
+	for (int shift = 32; shift < 32 + 3 * RADIX_BITS; shift += RADIX_BITS) {
+		std::fill(offsets.begin(), offsets.end(), 0);
+		forChunks(0, n, [&](size_t c, uint32_t begin, uint32_t end) {
+			uint32_t* counts = &offsets[c * RADIX_SIZE];
+			for (uint32_t i = begin; i < end; i++)
+				counts[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+		});
+		//Digit major so equal digits keep their chunk order, which keeps the sort stable
+		uint32_t sum = 0;
+		for (uint32_t d = 0; d < RADIX_SIZE; d++) {
+			for (size_t c = 0; c < chunks; c++) {
+				uint32_t count = offsets[c * RADIX_SIZE + d];
+				offsets[c * RADIX_SIZE + d] = sum;
+				sum += count;
+			}
+		}
+		forChunks(0, n, [&](size_t c, uint32_t begin, uint32_t end) {
+			uint32_t* next = &offsets[c * RADIX_SIZE];
+			for (uint32_t i = begin; i < end; i++)
+				sorted[next[(keys[i] >> shift) & (RADIX_SIZE - 1)]++] = keys[i];
+		});
+		keys.swap(sorted);
+	}
+
+	ctx.mortonCodes.resize(n);
+	forChunks(0, n, [&](size_t, uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			primIndices[i] = (uint32_t)keys[i];
+			ctx.mortonCodes[i] = (uint32_t)(keys[i] >> 32);
+		}
+	});
+}
+
+BVH::Split BVH::findSplit(BuildContext& ctx, uint32_t begin, uint32_t end, const Bounds3f& bounds, const Bounds3f& centroidBounds, bool parallel) {
+	uint32_t count = end - begin;
+	Split split{ begin, 0 };
+	if (count <= MAX_LEAF_SIZE)
+		return split;
+
+	if (ctx.method == BuildMethod::Morton) {
+		//Already sorted, so the split is where the highest differing code bit flips
+		uint32_t first = ctx.mortonCodes[begin];
+		uint32_t diff = first ^ ctx.mortonCodes[end - 1];
+		if (diff == 0) //Same cell, split anywhere to keep leaves small
+			return { begin + count / 2, 0 };
+		int bit = 31;
+		while ((diff >> bit) == 0)
+			bit--;
+		split.mid = (uint32_t)(std::partition_point(ctx.mortonCodes.begin() + begin, ctx.mortonCodes.begin() + end,
+			[bit](uint32_t code) { return ((code >> bit) & 1) == 0; }) - ctx.mortonCodes.begin());
+		split.axis = 2 - bit % 3;
+		return split;
+	}
+
+	int axis = centroidBounds.maxExtent();
+	if (centroidBounds.diagonal()[axis] > 0) {
+		//Bin centroids along the widest axis and pick the cheapest split between bins
+		auto binOf = [&](uint32_t prim) {
+			int b = (int)(NUM_BINS * centroidBounds.offset(ctx.centroids[prim])[axis]);
+			return std::min(b, NUM_BINS - 1);
+		};
+		auto binRange = [&](uint32_t rangeBegin, uint32_t rangeEnd, Bin* bins) {
+			for (uint32_t i = rangeBegin; i < rangeEnd; i++) {
+				Bin& bin = bins[binOf(primIndices[i])];
+				bin.bounds = merge(bin.bounds, ctx.primBounds[primIndices[i]]);
+				bin.count++;
+			}
+		};
+		Bin bins[NUM_BINS];
+		if (parallel) {
+			std::vector<std::array<Bin, NUM_BINS>> chunkBins(numChunks(begin, end));
+			forChunks(begin, end, [&](size_t c, uint32_t chunkBegin, uint32_t chunkEnd) {
+				binRange(chunkBegin, chunkEnd, chunkBins[c].data());
+			});
+			for (const std::array<Bin, NUM_BINS>& chunk : chunkBins) {
+				for (int b = 0; b < NUM_BINS; b++) {
+					bins[b].bounds = merge(bins[b].bounds, chunk[b].bounds);
+					bins[b].count += chunk[b].count;
+				}
+			}
+		} else {
+			binRange(begin, end, bins);
+		}
+
+		float costs[NUM_BINS - 1];
+		Bounds3f below;
+		uint32_t countBelow = 0;
+		for (int b = 0; b < NUM_BINS - 1; b++) {
+			below = merge(below, bins[b].bounds);
+			countBelow += bins[b].count;
+			costs[b] = countBelow * below.surfaceArea();
+		}
+		Bounds3f above;
+		uint32_t countAbove = 0;
+		for (int b = NUM_BINS - 1; b > 0; b--) {
+			above = merge(above, bins[b].bounds);
+			countAbove += bins[b].count;
+			costs[b - 1] += countAbove * above.surfaceArea();
+		}
+
+		int bestSplit = (int)(std::min_element(costs, costs + NUM_BINS - 1) - costs);
+		float splitCost = 1 + costs[bestSplit] / bounds.surfaceArea();
+		if (splitCost < count || count > UINT16_MAX) {
+			auto below = [&](uint32_t prim) { return binOf(prim) <= bestSplit; };
+			split.axis = axis;
+			if (parallel) {
+				//Each chunk scatters its primitives to offsets given by a prefix sum over the chunks, then everything is copied back
+				uint32_t leftCount = 0;
+				for (int b = 0; b <= bestSplit; b++)
+					leftCount += bins[b].count;
+				std::vector<uint32_t> chunkLeft(numChunks(begin, end));
+				forChunks(begin, end, [&](size_t c, uint32_t chunkBegin, uint32_t chunkEnd) {
+					chunkLeft[c] = (uint32_t)std::count_if(primIndices.begin() + chunkBegin, primIndices.begin() + chunkEnd, below);
+				});
+				std::vector<uint32_t> leftStart(chunkLeft.size()), rightStart(chunkLeft.size());
+				uint32_t left = begin, right = begin + leftCount;
+				for (size_t c = 0; c < chunkLeft.size(); c++) {
+					leftStart[c] = left;
+					rightStart[c] = right;
+					left += chunkLeft[c];
+					right += std::min(CHUNK_SIZE, end - begin - (uint32_t)c * CHUNK_SIZE) - chunkLeft[c];
+				}
+				forChunks(begin, end, [&](size_t c, uint32_t chunkBegin, uint32_t chunkEnd) {
+					for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+						ctx.scratch[below(primIndices[i]) ? leftStart[c]++ : rightStart[c]++] = primIndices[i];
+				});
+				forChunks(begin, end, [&](size_t, uint32_t chunkBegin, uint32_t chunkEnd) {
+					std::copy(ctx.scratch.begin() + chunkBegin, ctx.scratch.begin() + chunkEnd, primIndices.begin() + chunkBegin);
+				});
+				split.mid = begin + leftCount;
+			} else {
+				split.mid = (uint32_t)(std::partition(primIndices.begin() + begin, primIndices.begin() + end, below) - primIndices.begin());
+			}
+		}
+	}
+	if ((split.mid == begin || split.mid == end) && count > UINT16_MAX) //Centroids coincide, split anywhere rather than overflow the leaf
+		split.mid = begin + count / 2;
+	if (split.mid == end)
+		split.mid = begin;
+	return split;
+}
+
+int32_t BVH::buildTop(BuildContext& ctx, std::vector<TopNode>& top, std::vector<BuildTask>& tasks, uint32_t begin, uint32_t end, uint32_t taskSize) {
+	Split split{ begin, 0 };
+	Bounds3f bounds;
+	if (end - begin > taskSize) {
+		std::vector<Bounds3f> chunkBounds(numChunks(begin, end)), chunkCentroidBounds(chunkBounds.size());
+		forChunks(begin, end, [&](size_t c, uint32_t chunkBegin, uint32_t chunkEnd) {
+			rangeBounds(ctx.primBounds, ctx.centroids, &primIndices[chunkBegin], chunkEnd - chunkBegin, chunkBounds[c], chunkCentroidBounds[c]);
+		});
+		Bounds3f centroidBounds;
+		for (size_t c = 0; c < chunkBounds.size(); c++) {
+			bounds = merge(bounds, chunkBounds[c]);
+			centroidBounds = merge(centroidBounds, chunkCentroidBounds[c]);
+		}
+		split = findSplit(ctx, begin, end, bounds, centroidBounds, true);
+	}
+	if (split.mid == begin) {
+		tasks.push_back({ begin, end, 0, {} }); //base is assigned by layout
+		return ~(int32_t)(tasks.size() - 1);
+	}
+
+	int32_t index = (int32_t)top.size();
+	top.push_back({ bounds, split.axis, { 0, 0 } });
+	int32_t first = buildTop(ctx, top, tasks, begin, split.mid, taskSize);
+	int32_t second = buildTop(ctx, top, tasks, split.mid, end, taskSize);
+	top[index].children[0] = first;
+	top[index].children[1] = second;
+	return index;
+}
+
+uint32_t BVH::buildSubtree(BuildContext& ctx, std::vector<BVHNode>& out, uint32_t begin, uint32_t end) {
+	uint32_t index = (uint32_t)out.size();
+	out.emplace_back();
+
+	Bounds3f bounds, centroidBounds;
+	rangeBounds(ctx.primBounds, ctx.centroids, &primIndices[begin], end - begin, bounds, centroidBounds);
+	out[index].bounds = bounds;
+
+	Split split = findSplit(ctx, begin, end, bounds, centroidBounds, false);
+	if (split.mid == begin) {
+		out[index].offset = begin;
+		out[index].count = (uint16_t)(end - begin);
+		out[index].axis = 0;
+	} else {
+		buildSubtree(ctx, out, begin, split.mid);
+		uint32_t second = buildSubtree(ctx, out, split.mid, end);
+		out[index].offset = second;
+		out[index].count = 0;
+		out[index].axis = (uint8_t)split.axis;
+	}
+	return index;
+}
+
+uint32_t BVH::layout(const std::vector<TopNode>& top, std::vector<BuildTask>& tasks, int32_t ref) {
+	uint32_t index = (uint32_t)nodes.size();
+	if (ref < 0) {
+		BuildTask& task = tasks[~ref];
+		task.base = index;
+		nodes.resize(index + task.nodes.size());
+		refitTasks.push_back({ index, (uint32_t)nodes.size() });
+		return index;
+	}
+
+	const TopNode& node = top[ref];
+	nodes.emplace_back();
+	topNodes.push_back(index);
+	layout(top, tasks, node.children[0]);
+	uint32_t second = layout(top, tasks, node.children[1]);
+	nodes[index].bounds = node.bounds;
+	nodes[index].offset = second;
+	nodes[index].count = 0;
+	nodes[index].axis = (uint8_t)node.axis;
+	return index;
+}
+
+void BVH::refitNode(uint32_t index, const std::vector<Bounds3f>& primBounds) {
+	BVHNode& node = nodes[index];
+	if (node.count > 0) {
+		Bounds3f bounds;
+		for (uint32_t i = 0; i < node.count; i++)
+			bounds = merge(bounds, primBounds[primIndices[node.offset + i]]);
+		node.bounds = bounds;
+	} else {
+		node.bounds = merge(nodes[index + 1].bounds, nodes[node.offset].bounds);
+	}
+}
+
+void BVH::refit(const std::vector<Bounds3f>& primBounds) {
+	//Children always come after their parent, so walking backwards refits bottom up
+	getThreadPool().parallelFor(refitTasks.size(), [&](size_t task, size_t) {
+		for (uint32_t i = refitTasks[task].end; i-- > refitTasks[task].root;)
+			refitNode(i, primBounds);
+	});
+	for (size_t i = topNodes.size(); i-- > 0;)
+		refitNode(topNodes[i], primBounds);
+}
+
+float BVH::sahCost() const {
+	if (nodes.empty())
+		return 0;
+	float cost = 0;
+	for (const BVHNode& node : nodes)
+		cost += node.bounds.surfaceArea() * (node.count > 0 ? node.count : 1);
+	float rootArea = nodes[0].bounds.surfaceArea();
+	return rootArea > 0 ? cost / rootArea : 0;
+}
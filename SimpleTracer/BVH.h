@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Bounds.h"
+#include "Ray.h"
+#include <cstdint>
+#include <vector>
+
+//Nodes are laid out depth first: an interior node's first child comes right after it
+struct BVHNode {
+	Bounds3f bounds;
+	uint32_t offset; //Leaf: first entry in primIndices. Interior: index of the second child
+	uint16_t count; //Primitives in a leaf, 0 for interior nodes
+	uint8_t axis; //Split axis of an interior node, decides which child is visited first
+};
+
+//Bounding volume hierarchy over anything that can give a bounding box per primitive.
+//It only stores indices, so callers intersect their own primitives in the traversal callback
+struct BVH {
+public:
+	enum class BuildMethod {
+		BinnedSAH, //Binned surface area heuristic splits, the best trees
+		Morton //Sorts centroids along a Morton curve and splits on code bits, much quicker to build but slower to trace
+	};
+private:
+	struct Subtree {
+		uint32_t root;
+		uint32_t end; //One past the last node of the subtree
+	};
+
+	struct Split {
+		uint32_t mid; //begin when the range should stay a leaf
+		int axis;
+	};
+
+	struct BuildContext;
+	struct TopNode;
+	struct BuildTask;
+
+	std::vector<BVHNode> nodes;
+	std::vector<uint32_t> primIndices;
+	std::vector<Subtree> refitTasks; //Disjoint subtrees built and refitted in parallel
+	std::vector<uint32_t> topNodes; //Everything above refitTasks in depth first order, refitted serially after
+	double buildSeconds = 0;
+
+	void sortMorton(BuildContext& ctx);
+
+	Split findSplit(BuildContext& ctx, uint32_t begin, uint32_t end, const Bounds3f& bounds, const Bounds3f& centroidBounds, bool parallel);
+
+	int32_t buildTop(BuildContext& ctx, std::vector<TopNode>& top, std::vector<BuildTask>& tasks, uint32_t begin, uint32_t end, uint32_t taskSize);
+
+	uint32_t buildSubtree(BuildContext& ctx, std::vector<BVHNode>& out, uint32_t begin, uint32_t end);
+
+	uint32_t layout(const std::vector<TopNode>& top, std::vector<BuildTask>& tasks, int32_t ref);
+
+	void refitNode(uint32_t index, const std::vector<Bounds3f>& primBounds);
+public:
+	static constexpr int MAX_LEAF_SIZE = 4;
+	static constexpr int NUM_BINS = 12;
+	static constexpr uint32_t MIN_TASK_SIZE = 4096; //Smaller ranges are built serially by a single task
+	static constexpr uint32_t TASKS_PER_THREAD = 4;
+
+	//Splits of large ranges are found with parallel reductions over the thread pool, after which subtrees are built as independent tasks
+	void build(const std::vector<Bounds3f>& primBounds, BuildMethod method = BuildMethod::BinnedSAH);
+
+	//Wall clock time the last build took
+	double getBuildSeconds() const {
+		return buildSeconds;
+	}
+
+	//Updates every node's bounds for moved primitives without changing the topology
+	void refit(const std::vector<Bounds3f>& primBounds);
+
+	//Expected cost of tracing a ray under the surface area heuristic, refitting moving primitives makes it grow
+	float sahCost() const;
+
+	bool isEmpty() const {
+		return nodes.empty();
+	}
+
+	//intersectPrim(primIndex) returns whether it hit and is expected to shorten ray.tMax when it does
+	template<typename F>
+	bool intersect(const Ray& ray, const F& intersectPrim) const {
+		if (nodes.empty())
+			return false;
+
+		Vec3f invDir{ 1 / ray.dir.x, 1 / ray.dir.y, 1 / ray.dir.z };
+		bool dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+		uint32_t stack[64];
+		int stackSize = 0;
+		uint32_t current = 0;
+		bool hit = false;
+		while (true) {
+			const BVHNode& node = nodes[current];
+			if (node.bounds.intersectP(ray, invDir)) {
+				if (node.count > 0) {
+					for (uint32_t i = 0; i < node.count; i++) {
+						if (intersectPrim(primIndices[node.offset + i]))
+							hit = true;
+					}
+				} else if (dirIsNeg[node.axis]) { //Visit the near child first so tMax shrinks sooner
+					stack[stackSize++] = current + 1;
+					current = node.offset;
+					continue;
+				} else {
+					stack[stackSize++] = node.offset;
+					current = current + 1;
+					continue;
+				}
+			}
+			if (stackSize == 0)
+				break;
+			current = stack[--stackSize];
+		}
+		return hit;
+	}
+
+	//occludedPrim(primIndex) returns whether the primitive blocks the ray, traversal stops at the first one that does
+	template<typename F>
+	bool occluded(const Ray& ray, const F& occludedPrim) const {
+		if (nodes.empty())
+			return false;
+
+		Vec3f invDir{ 1 / ray.dir.x, 1 / ray.dir.y, 1 / ray.dir.z };
+		uint32_t stack[64];
+		int stackSize = 0;
+		uint32_t current = 0;
+		while (true) {
+			const BVHNode& node = nodes[current];
+			if (node.bounds.intersectP(ray, invDir)) {
+				if (node.count > 0) {
+					for (uint32_t i = 0; i < node.count; i++) {
+						if (occludedPrim(primIndices[node.offset + i]))
+							return true;
+					}
+				} else {
+					stack[stackSize++] = node.offset;
+					current = current + 1;
+					continue;
+				}
+			}
+			if (stackSize == 0)
+				return false;
+			current = stack[--stackSize];
+		}
+	}
+};
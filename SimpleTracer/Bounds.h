@@ -0,0 +1,128 @@
+#pragma once
+
+#include "LinearAlg.h"
+#include "Ray.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//Axis aligned bounding box, default constructs empty so merging into it just works
+struct Bounds3f {
+	Poi3f min;
+	Poi3f max;
+
+	Bounds3f() :
+		min({ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() }),
+		max({ std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() })
+	{}
+
+	Bounds3f(const Poi3f& p) :
+		min(p),
+		max(p)
+	{}
+
+	Bounds3f(const Poi3f& a, const Poi3f& b) :
+		min({ std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) }),
+		max({ std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) })
+	{}
+
+	bool isEmpty() const {
+		return min.x > max.x || min.y > max.y || min.z > max.z;
+	}
+
+	Vec3f diagonal() const {
+		return max - min;
+	}
+
+	Poi3f centroid() const {
+		return min + 0.5f * diagonal();
+	}
+
+	float surfaceArea() const {
+		if (isEmpty())
+			return 0;
+		Vec3f d = diagonal();
+		return 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
+	}
+
+	int maxExtent() const {
+		Vec3f d = diagonal();
+		if (d.x > d.y && d.x > d.z)
+			return 0;
+		return d.y > d.z ? 1 : 2;
+	}
+
+	//Where p sits inside the box, 0 at min and 1 at max along each axis
+	Vec3f offset(const Poi3f& p) const {
+		Vec3f o = p - min;
+		Vec3f d = diagonal();
+		for (int i = 0; i < 3; i++)
+			if (d[i] > 0)
+				o[i] /= d[i];
+		return o;
+	}
+
+	//Slab test against the ray's [tMin, tMax], invDir is 1 / ray.dir precomputed by the caller
+	bool intersectP(const Ray& ray, const Vec3f& invDir) const {
+		float t0 = ray.tMin;
+		float t1 = ray.tMax;
+		for (int i = 0; i < 3; i++) {
+			float tNear = (min[i] - ray.org[i]) * invDir[i];
+			float tFar = (max[i] - ray.org[i]) * invDir[i];
+			if (tNear > tFar)
+				std::swap(tNear, tFar);
+			t0 = tNear > t0 ? tNear : t0;
+			t1 = tFar < t1 ? tFar : t1;
+			if (t0 > t1)
+				return false;
+		}
+		return true;
+	}
+
+	friend Bounds3f merge(const Bounds3f& a, const Bounds3f& b) {
+		Bounds3f m;
+		for (int i = 0; i < 3; i++) {
+			m.min[i] = std::min(a.min[i], b.min[i]);
+			m.max[i] = std::max(a.max[i], b.max[i]);
+		}
+		return m;
+	}
+
+	friend Bounds3f merge(const Bounds3f& b, const Poi3f& p) {
+		return merge(b, Bounds3f(p));
+	}
+};
+
+//Directions within an angle of w, kept as the angle's cosine. Bounds which way a group of surfaces faces
+struct DirectionCone {
+	Vec3f w;
+	float cosTheta;
+
+	static DirectionCone entireSphere() {
+		return { { 0, 0, 1 }, -1 };
+	}
+
+	//Smallest cone around both
+	friend DirectionCone merge(const DirectionCone& a, const DirectionCone& b) {
+		float thetaA = std::acos(std::max(-1.0f, std::min(1.0f, a.cosTheta)));
+		float thetaB = std::acos(std::max(-1.0f, std::min(1.0f, b.cosTheta)));
+		float thetaD = std::acos(std::max(-1.0f, std::min(1.0f, dot(a.w, b.w))));
+		if (std::min(thetaD + thetaB, PI) <= thetaA)
+			return a;
+		if (std::min(thetaD + thetaA, PI) <= thetaB)
+			return b;
+
+		float thetaO = (thetaA + thetaD + thetaB) / 2;
+		if (thetaO >= PI)
+			return entireSphere();
+		Vec3f axis = cross(a.w, b.w);
+		if (axis.lengthSq() == 0)
+			return entireSphere();
+
+		//Rotate a.w towards b.w so the new cone just touches the far edges of both
+		axis = normalize(axis);
+		float thetaR = thetaO - thetaA;
+		Vec3f w = std::cos(thetaR) * a.w + std::sin(thetaR) * cross(axis, a.w);
+		return { normalize(w), std::cos(thetaO) };
+	}
+};
\ No newline at end of file
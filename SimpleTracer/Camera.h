@@ -6,9 +6,17 @@
 #include "Transform.h"
 #include "Ray.h"
 #include "Image.h"
+#include "Film.h"
+#include "Tile.h"
 #include "Renderer.h"
 #include "Random.h"
-#include <future>
+#include "ThreadPool.h"
+#include "StreamingImageWriter.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+#include "Telemetry.h"
+#include <string>
+#include <vector>
 
 struct ViewingFrustum {
 	float aspectRatio;
@@ -37,6 +45,15 @@ struct ViewingFrustum {
 	Ray generateRay(Poi2f ndc) const {
 		return { origin, (topLeft + ndc.y * down + ndc.x * across) - origin };
 	}
+
+	//Inverse of generateRay for a camera space point, false if it is not in front of the camera
+	bool project(const Poi3f& p, Poi2f& ndc) const {
+		if (p.z >= 0)
+			return false;
+		Vec3f onPlane = (p - origin) * (-1 / p.z); //Scaled onto the z = -1 plane the frustum's corners lie on
+		ndc = Poi2f{ (onPlane.x - topLeft.x) / across.x, (onPlane.y - topLeft.y) / down.y };
+		return true;
+	}
 };
 
 struct Camera {
@@ -45,6 +62,12 @@ private:
 	Vec2i resolution;
 	int aaNumSamples;
 	Renderer renderer;
+
+	//TILE_SIZE * TILE_SIZE values for the calling thread
+	static Vec3f* getTileBuffer() {
+		thread_local std::vector<Vec3f> buffer(TILE_SIZE * TILE_SIZE);
+		return buffer.data();
+	}
 public:
 	Camera(Vec2i resolution, float verticalFov, Renderer renderer, int aaNumSamples = 1) :
 		resolution(resolution),
@@ -63,44 +86,154 @@ public:
 	}
 	*/
 
-	Image renderImage(const Transform& camToWorld) const {
+	Vec2i getResolution() const {
+		return resolution;
+	}
+
+	float getVerticalFov() const {
+		return verticalFov;
+	}
+
+	//Angle one pixel covers, how fast primary ray cones open
+	float getPixelSpread() const {
+		return 2 * (float)tan(verticalFov / 2 * PI / 180) / resolution.y;
+	}
+
+	const Renderer& getRenderer() const {
+		return renderer;
+	}
+
+	//Every primary ray from camToWorld leaves the same point, so the work each object does with just that point is done
+	//here once per frame and handed to renderTile. Stale once the camera or anything in the scene moves
+	void prepareOrigin(const Transform& camToWorld, SharedOrigin& origin) const {
+		ViewingFrustum f{ resolution, verticalFov };
+		renderer.getScene().prepareOrigin(camToWorld(f.origin), origin);
+	}
+
+	//Fills out with tile.getArea() row-major values of averaged linear radiance
+	void renderTile(const Transform& camToWorld, const Tile& tile, Vec3f* out) const {
+		renderTile(camToWorld, tile, out, renderer);
+	}
+
+	//Same, adding everything the tile's paths depended on to footprint. origin is optional, see prepareOrigin
+	void renderTile(const Transform& camToWorld, const Tile& tile, Vec3f* out, Footprint* footprint,
+		const SharedOrigin* origin = nullptr) const {
+		renderTile(camToWorld, tile, out, renderer, footprint, origin);
+	}
+
+	//Same but traced through another renderer, e.g. one holding a node local copy of the scene
+	void renderTile(const Transform& camToWorld, const Tile& tile, Vec3f* out, const Renderer& renderer, Footprint* footprint = nullptr,
+		const SharedOrigin* origin = nullptr) const {
+		TRACE_SCOPE("Tile", "x", tile.x0, "y", tile.y0);
 		int width = resolution.x;
 		int height = resolution.y;
-
-		Image img = Image(width, height);
 		ViewingFrustum f{ resolution, verticalFov };
+		float pixelSpread = getPixelSpread();
 
-		int numSamples = aaNumSamples;
-		const Renderer& renderer = this->renderer;
-		auto sampler = [width, height, &camToWorld, &f, &renderer](int x, int y) {
-			Poi2f ndc{ (float)(x + randomD()) / width, (float)(y + randomD()) / height };
-			Ray r = camToWorld(f.generateRay(ndc));
-			Vec3f c = renderer.color(r);
-			return c;
-		};
+		//Every sample of every pixel in the tile, traced PATH_BATCH_SIZE at a time
+		thread_local std::vector<PathState> paths;
+		size_t numPixels = tile.getArea();
+		size_t numPaths = numPixels * aaNumSamples;
+		std::fill(out, out + numPixels, Vec3f{ 0, 0, 0 });
+		for (size_t begin = 0; begin < numPaths; begin += PATH_BATCH_SIZE) {
+			paths.resize(std::min(PATH_BATCH_SIZE, numPaths - begin));
+			for (size_t i = 0; i < paths.size(); i++) {
+				uint32_t pixel = (uint32_t)((begin + i) / aaNumSamples);
+				int x = tile.x0 + pixel % tile.getWidth();
+				int y = tile.y0 + pixel / tile.getWidth();
+				Poi2f ndc{ (float)(x + randomD()) / width, (float)(y + randomD()) / height };
+				Ray r = camToWorld(f.generateRay(ndc));
+				r.coneSpread = pixelSpread;
+				paths[i] = { r, { 1, 1, 1 }, { 0, 0, 0 }, pixel };
+			}
+			renderer.trace(paths.data(), paths.size(), footprint, origin);
+			for (const PathState& path : paths)
+				out[path.pixel] += path.radiance;
+		}
+		for (size_t i = 0; i < numPixels; i++)
+			out[i] /= (float)aaNumSamples;
+		recordTileDone(numPaths);
+	}
 
-		std::future<Vec3f>* samples = new std::future<Vec3f>[numSamples]();
+	//Renders every tile in parallel, handing each one to onTile(tile, radiance) on the thread that rendered it.
+	//Buffers are kept per thread between calls, so after the first frame a render allocates nothing itself
+	template<typename F>
+	void renderTiles(const Transform& camToWorld, const F& onTile) const {
+		thread_local std::vector<Tile> threadTiles;
+		thread_local SharedOrigin threadOrigin;
+		//Lambdas don't capture thread_locals, so the pool's threads are handed the calling thread's through references
+		std::vector<Tile>& tiles = threadTiles;
+		SharedOrigin& origin = threadOrigin;
+		tiles.clear();
+		appendTiles(resolution, TILE_SIZE, tiles);
+		prepareOrigin(camToWorld, origin);
+		expectTiles(tiles.size());
+		getThreadPool().parallelFor(tiles.size(), [&](size_t i, size_t) {
+			Vec3f* tileBuffer = getTileBuffer();
+			renderTile(camToWorld, tiles[i], tileBuffer, renderer, nullptr, &origin);
+			CounterScope counters(PHASE_OUTPUT);
+			onTile(tiles[i], tileBuffer);
+		});
+	}
 
-		for (int y = 0; y < height; y++) {
-			for (int x = 0; x < width; x++) {
-				Vec3f cAvg{0, 0, 0};
-				
-				/*for (int i = 0; i < numSamples; i++) {
-					samples[i] = std::async(std::launch::async, sampler, x, y);
-				}*/
+	//Renders a tile on every pool thread so each one grows its per-thread buffers now. Frames rendered after, with
+	//the same settings, allocate nothing themselves; otherwise a thread does so on the first tile it happens to get.
+	//The tiles are expected like any others, so telemetry never counts more done than set out to do
+	void warmUp(const Transform& camToWorld) const {
+		Tile tile{ 0, 0, std::min(TILE_SIZE, resolution.x), std::min(TILE_SIZE, resolution.y) };
+		ThreadPool& pool = getThreadPool();
+		expectTiles(pool.getNumThreads());
+		pool.forEachThread([&](size_t) {
+			renderTile(camToWorld, tile, getTileBuffer());
+		});
+	}
 
-				for (int i = 0; i < numSamples; i++) {
-					cAvg += sampler(x, y);//samples[i].get();
-				}
-				cAvg /= (float)numSamples;
-				cAvg = { sqrt(std::min(cAvg.x, 1.0f)), sqrt(std::min(cAvg.y, 1.0f)), sqrt(std::min(cAvg.z, 1.0f)) };
+	//Into a film the caller keeps and reuses between frames, film must match the resolution
+	void renderImage(const Transform& camToWorld, Film& film) const {
+		renderTiles(camToWorld, [&film](const Tile& tile, const Vec3f* radiance) {
+			film.putTile(tile, radiance);
+		});
+	}
 
-				img(x, y) = Vec3<uint8_t>(cAvg * 255);
-			}
+	Image renderImage(const Transform& camToWorld) const {
+		Film film(resolution.x, resolution.y);
+		renderImage(camToWorld, film);
+		TRACE_SCOPE("Tonemap");
+		CounterScope counters(PHASE_OUTPUT);
+		return film.toImage();
+	}
+
+	//Path guided render: training passes of 1, 2, 4... samples per pixel teach guide where light comes from, then
+	//aaNumSamples are traced with what it learned. Every pass is unbiased so all of them are kept, weighted by sample count
+	Image renderGuided(const Transform& camToWorld, PathGuide& guide, int numTrainingPasses) const {
+		Camera pass = *this;
+		pass.renderer.setGuide(&guide);
+		Film film(resolution.x, resolution.y);
+		int totalSamples = 0;
+		auto accumulate = [&film, &pass](const Tile& tile, const Vec3f* radiance) {
+			film.addTile(tile, radiance, (float)pass.aaNumSamples);
+		};
+		guide.setLearning(true);
+		for (int i = 0; i < numTrainingPasses; i++) {
+			pass.aaNumSamples = 1 << i;
+			pass.renderTiles(camToWorld, accumulate);
+			totalSamples += pass.aaNumSamples;
+			guide.refine();
 		}
-		delete[] samples;
+		guide.setLearning(false);
+		pass.aaNumSamples = aaNumSamples;
+		pass.renderTiles(camToWorld, accumulate);
+		totalSamples += aaNumSamples;
+		return film.toImage(1.0f / totalSamples);
+	}
 
-		return img;
+	//Streams tiles to a ppm at path as they finish instead of holding the frame in memory
+	void renderToFile(const Transform& camToWorld, const std::string& path) const {
+		StreamingImageWriter writer(path, resolution.x, resolution.y);
+		renderTiles(camToWorld, [&writer](const Tile& tile, const Vec3f* radiance) {
+			writer.write(tile, radiance);
+		});
+		writer.finish();
 	}
 
 	
@@ -0,0 +1,158 @@
+#include "Convergence.h"
+#include "Camera.h"
+#include "RadianceCache.h"
+#include "Scenes.h"
+#include "Timer.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+//Keeps relMse finite where the reference is black
+static constexpr double REL_MSE_EPSILON = 0.01;
+
+//Standard deviation in pixels of the blur applied before the perceptual difference
+static constexpr float PERCEPTUAL_BLUR_SIGMA = 1;
+
+//Displayed color as CIELAB: undo toPixel's gamma to get the clamped linear value, then linear sRGB to XYZ to Lab (D65)
+static Vec3f toLab(const Vec3f& radiance) {
+	float r = std::max(0.0f, std::min(radiance.x, 1.0f));
+	float g = std::max(0.0f, std::min(radiance.y, 1.0f));
+	float b = std::max(0.0f, std::min(radiance.z, 1.0f));
+	float xyz[3] = {
+		(0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f,
+		0.2126f * r + 0.7152f * g + 0.0722f * b,
+		(0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f
+	};
+	for (float& t : xyz)
+		t = t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116;
+	return { 116 * xyz[1] - 16, 500 * (xyz[0] - xyz[1]), 200 * (xyz[1] - xyz[2]) };
+}
+
+//Separable gaussian, edges clamped
+static void blur(std::vector<Vec3f>& image, size_t width, size_t height, float sigma) {
+	int radius = (int)std::ceil(3 * sigma);
+	std::vector<float> weights(2 * radius + 1);
+	float total = 0;
+	for (int i = -radius; i <= radius; i++)
+		total += weights[i + radius] = std::exp(-i * i / (2 * sigma * sigma));
+	for (float& w : weights)
+		w /= total;
+
+	std::vector<Vec3f> temp(image.size());
+	for (int pass = 0; pass < 2; pass++) {
+		size_t length = pass == 0 ? width : height;
+		for (size_t y = 0; y < height; y++) {
+			for (size_t x = 0; x < width; x++) {
+				Vec3f sum{ 0, 0, 0 };
+				size_t at = pass == 0 ? x : y;
+				for (int i = -radius; i <= radius; i++) {
+					size_t j = (size_t)std::max(0, std::min((int)length - 1, (int)at + i));
+					sum += image[pass == 0 ? y * width + j : j * width + x] * weights[i + radius];
+				}
+				temp[y * width + x] = sum;
+			}
+		}
+		image.swap(temp);
+	}
+}
+
+ImageError compareImages(const Film& test, const Film& reference, float testScale) {
+	size_t width = reference.getWidth();
+	size_t height = reference.getHeight();
+	if (test.getWidth() != width || test.getHeight() != height)
+		throw "Compared images differ in size";
+
+	double squared = 0, relative = 0;
+	std::vector<Vec3f> testLab(width * height), referenceLab(width * height);
+	for (size_t y = 0; y < height; y++) {
+		for (size_t x = 0; x < width; x++) {
+			Vec3f t = test(x, y) * testScale;
+			Vec3f r = reference(x, y);
+			for (int c = 0; c < 3; c++) {
+				double d = (double)t[c] - r[c];
+				squared += d * d;
+				relative += d * d / ((double)r[c] * r[c] + REL_MSE_EPSILON);
+			}
+			testLab[y * width + x] = toLab(t);
+			referenceLab[y * width + x] = toLab(r);
+		}
+	}
+
+	blur(testLab, width, height, PERCEPTUAL_BLUR_SIGMA);
+	blur(referenceLab, width, height, PERCEPTUAL_BLUR_SIGMA);
+	double deltaE = 0;
+	for (size_t i = 0; i < testLab.size(); i++)
+		deltaE += (testLab[i] - referenceLab[i]).length();
+
+	size_t numValues = width * height * 3;
+	return { std::sqrt(squared / numValues), relative / numValues, deltaE / (width * height) };
+}
+
+Film ConvergenceBenchmark::loadReference(const std::string& sceneName) const {
+	std::string path = "reference_" + sceneName + ".pfm";
+	std::ifstream existing(path, std::ifstream::binary);
+	if (existing) {
+		Film reference = Film::readPfm(existing);
+		if (reference.getWidth() != (size_t)settings.resolution.x || reference.getHeight() != (size_t)settings.resolution.y)
+			throw "Stored reference does not match the benchmark resolution";
+		return reference;
+	}
+
+	std::cout << "Rendering " << path << " at " << settings.referenceSamples << " samples per pixel" << std::endl;
+	Camera camera{ settings.resolution, settings.verticalFov, Renderer{ makeScene(sceneName) }, settings.referenceSamples };
+	Film reference(settings.resolution.x, settings.resolution.y);
+	camera.renderTiles({}, [&reference](const Tile& tile, const Vec3f* radiance) {
+		reference.putTile(tile, radiance);
+	});
+	std::ofstream file(path, std::ofstream::binary);
+	reference.writePfm(file);
+	return reference;
+}
+
+void ConvergenceBenchmark::writeCsvHeader(std::ostream& csv) {
+	csv << "label,scene,seconds,samples,rmse,relmse,perceptual\n";
+}
+
+void ConvergenceBenchmark::run(std::ostream& csv) const {
+	for (const std::string& sceneName : settings.scenes) {
+		Film reference = loadReference(sceneName);
+
+		Renderer renderer{ makeScene(sceneName) };
+		std::unique_ptr<RadianceCache> cache;
+		if (settings.cacheCellSize > 0) {
+			cache = std::make_unique<RadianceCache>(settings.cacheCellSize);
+			renderer.setRadianceCache(cache.get());
+		}
+		Camera camera{ settings.resolution, settings.verticalFov, renderer, 1 };
+		Film film(settings.resolution.x, settings.resolution.y);
+
+		//Only time spent rendering counts, the timer is marked again after each comparison
+		Timer timer;
+		double elapsed = 0;
+		double budget = settings.firstBudget;
+		int passes = 0;
+		for (int measured = 0; measured < settings.numBudgets;) {
+			camera.renderTiles({}, [&film](const Tile& tile, const Vec3f* radiance) {
+				film.addTile(tile, radiance);
+			});
+			passes++;
+			elapsed += timer.mark().count();
+			if (elapsed < budget)
+				continue;
+
+			ImageError error = compareImages(film, reference, 1.0f / passes);
+			csv << settings.label << "," << sceneName << "," << elapsed << "," << passes << ","
+				<< error.rmse << "," << error.relMse << "," << error.perceptual << "\n";
+			std::cout << sceneName << " " << elapsed << "s " << passes << "spp: rmse " << error.rmse
+				<< " relmse " << error.relMse << " perceptual " << error.perceptual << std::endl;
+			while (measured < settings.numBudgets && elapsed >= budget) { //A slow pass can cross several budgets
+				measured++;
+				budget *= 2;
+			}
+			timer.mark();
+		}
+		csv.flush();
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Film.h"
+#include "LinearAlg.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+//How far a render is from a reference, all computed over the whole image
+struct ImageError {
+	double rmse; //Over linear radiance
+	double relMse; //Squared error over squared reference, so dark regions count as much as bright ones
+
+	//Mean CIELAB color difference of the displayed images after a small blur standing in for the eye's contrast
+	//sensitivity. In the spirit of FLIP (Andersson et al. 2020) without its full pipeline, 0 means identical
+	double perceptual;
+};
+
+//Compares test * testScale to reference, which must be the same size
+ImageError compareImages(const Film& test, const Film& reference, float testScale = 1);
+
+//Error against time for the demo scenes: each is rendered one sample per pixel a pass, and whenever the time spent
+//crosses the next budget (doubling from firstBudget) the accumulated image is compared to a stored high sample count
+//reference. Rows go to a csv tagged with label, so runs of different commits can append to one file and be plotted
+//against each other. References are rendered once, unbiased, and kept next to the executable as reference_<scene>.pfm
+struct ConvergenceBenchmark {
+	struct Settings {
+		std::vector<std::string> scenes = { "default", "indoor", "outdoor" };
+		Vec2i resolution = { 160, 90 };
+		float verticalFov = 90;
+		int referenceSamples = 4096;
+		double firstBudget = 0.5; //Seconds
+		int numBudgets = 6;
+		float cacheCellSize = 0; //Renders through a radiance cache with cells this big, 0 for none
+		std::string label = "current";
+	};
+private:
+	Settings settings;
+
+	//Reads the scene's reference, rendering and saving it first if there is none yet
+	Film loadReference(const std::string& sceneName) const;
+public:
+	ConvergenceBenchmark(const Settings& settings) :
+		settings(settings)
+	{}
+
+	static void writeCsvHeader(std::ostream& csv);
+
+	//Appends one row per scene and budget to csv, and reports them on std::cout as they come
+	void run(std::ostream& csv) const;
+};
@@ -0,0 +1,190 @@
+#include "Distributed.h"
+#include "Camera.h"
+#include "Film.h"
+#include "Random.h"
+#include "Socket.h"
+#include "Telemetry.h"
+#include "Tile.h"
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static_assert(sizeof(Vec3f) == 3 * sizeof(float), "Tile results are sent as packed floats");
+
+enum class MessageType : uint32_t {
+	Job,
+	Tile,
+	TileResult,
+	Shutdown
+};
+
+struct MessageHeader {
+	MessageType type;
+	uint32_t size; //Bytes of payload following the header
+};
+
+static bool sendMessage(const Socket& s, MessageType type, const void* payload = nullptr, size_t size = 0) {
+	MessageHeader header{ type, (uint32_t)size };
+	return s.sendAll(&header, sizeof(header)) && (size == 0 || s.sendAll(payload, size));
+}
+
+//Bookkeeping shared by every connection thread of a coordinator
+struct TileQueue {
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<Tile> pending;
+	size_t numDone = 0;
+	size_t numTiles = 0;
+	int liveProcesses = 0;
+	int liveConnections = 0;
+
+	bool finished() const {
+		return numDone == numTiles;
+	}
+
+	bool hopeless() const {
+		return liveProcesses == 0 && liveConnections == 0;
+	}
+};
+
+static void serveWorker(Socket s, const RenderJob& job, TileQueue& queue, Film& film) {
+	std::vector<Vec3f> buffer;
+	bool alive = sendMessage(s, MessageType::Job, &job, sizeof(job));
+
+	while (alive) {
+		Tile tile;
+		{
+			std::unique_lock<std::mutex> lock(queue.mutex);
+			queue.changed.wait(lock, [&queue] { return !queue.pending.empty() || queue.finished(); });
+			if (queue.finished())
+				break;
+			tile = queue.pending.front();
+			queue.pending.pop_front();
+		}
+
+		buffer.resize(tile.getArea());
+		MessageHeader header;
+		Tile returned;
+		alive = sendMessage(s, MessageType::Tile, &tile, sizeof(tile))
+			&& s.recvAll(&header, sizeof(header))
+			&& header.type == MessageType::TileResult
+			&& header.size == sizeof(Tile) + buffer.size() * sizeof(Vec3f)
+			&& s.recvAll(&returned, sizeof(returned))
+			&& returned == tile
+			&& s.recvAll(buffer.data(), buffer.size() * sizeof(Vec3f));
+
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (alive) {
+			film.putTile(tile, buffer.data());
+			queue.numDone++;
+			recordTileDone((uint64_t)buffer.size() * job.aaNumSamples); //Rays are counted by the worker processes
+		} else { //Worker died, sent garbage or answered for another tile, someone else gets the tile
+			queue.pending.push_back(tile);
+		}
+		queue.changed.notify_all();
+	}
+
+	if (alive)
+		sendMessage(s, MessageType::Shutdown);
+
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	queue.liveConnections--;
+	queue.changed.notify_all();
+}
+
+Image Coordinator::render() const {
+	Film film(job.width, job.height);
+	TileQueue queue;
+	for (const Tile& tile : makeTiles({ job.width, job.height }, job.tileSize))
+		queue.pending.push_back(tile);
+	queue.numTiles = queue.pending.size();
+	expectTiles(queue.numTiles);
+	queue.liveProcesses = numWorkers;
+
+	Socket listener = Socket::listen(0);
+	uint16_t port = listener.getPort();
+
+	std::vector<std::thread> processes;
+	std::string command = "\"" + workerExecutable + "\" --worker " + std::to_string(port) + " --scene " + sceneName + workerFlags;
+	for (int i = 0; i < numWorkers; i++) {
+		processes.emplace_back([command, &queue] {
+			std::system(command.c_str());
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.liveProcesses--;
+			queue.changed.notify_all();
+		});
+	}
+
+	bool stopping = false;
+	std::vector<std::thread> connections;
+	std::thread acceptor([&] {
+		while (true) {
+			Socket s = listener.accept();
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (stopping)
+				break;
+			if (!s.isValid())
+				continue;
+			queue.liveConnections++;
+			connections.emplace_back(serveWorker, std::move(s), std::cref(job), std::ref(queue), std::ref(film));
+		}
+	});
+
+	bool finished;
+	{
+		std::unique_lock<std::mutex> lock(queue.mutex);
+		queue.changed.wait(lock, [&queue] { return queue.finished() || queue.hopeless(); });
+		finished = queue.finished();
+		stopping = true;
+		queue.changed.notify_all(); //Lets idle connections send their shutdown
+	}
+
+	//Accept is blocking, so poke the listener to let the acceptor see it should stop
+	Socket::connect("127.0.0.1", port);
+	acceptor.join();
+	listener.close(); //Workers still waiting in the backlog see the connection drop and quit instead of waiting on us forever
+	for (std::thread& t : connections)
+		t.join();
+	for (std::thread& t : processes)
+		t.join();
+
+	if (!finished)
+		throw "Every worker died before the render finished";
+	return film.toImage();
+}
+
+void runWorker(uint16_t port, std::shared_ptr<Scene> scene, RadianceCache* cache) {
+	Socket s;
+	try {
+		s = Socket::connect("127.0.0.1", port);
+	} catch (const char*) { //Started after the coordinator had every tile and stopped listening, nothing left to do
+		return;
+	}
+
+	MessageHeader header;
+	RenderJob job;
+	if (!s.recvAll(&header, sizeof(header)) || header.type != MessageType::Job || !s.recvAll(&job, sizeof(job)))
+		return;
+
+	Renderer renderer{ scene };
+	renderer.setRadianceCache(cache);
+	Camera camera{ { job.width, job.height }, job.verticalFov, renderer, job.aaNumSamples };
+	std::vector<Vec3f> buffer;
+	while (s.recvAll(&header, sizeof(header)) && header.type == MessageType::Tile) {
+		Tile tile;
+		if (!s.recvAll(&tile, sizeof(tile)))
+			return;
+
+		buffer.resize(tile.getArea());
+		seedThreadGenerator((unsigned)tile.y0 * job.width + tile.x0);
+		camera.renderTile(Transform(), tile, buffer.data());
+
+		size_t dataSize = buffer.size() * sizeof(Vec3f);
+		MessageHeader result{ MessageType::TileResult, (uint32_t)(sizeof(tile) + dataSize) };
+		if (!s.sendAll(&result, sizeof(result)) || !s.sendAll(&tile, sizeof(tile)) || !s.sendAll(buffer.data(), dataSize))
+			return;
+	}
+}
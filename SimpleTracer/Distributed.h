@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Image.h"
+#include "RadianceCache.h"
+#include "Scene.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+//Everything a worker needs besides the scene, sent to it as soon as it connects
+struct RenderJob {
+	int32_t width;
+	int32_t height;
+	float verticalFov;
+	int32_t aaNumSamples;
+	int32_t tileSize;
+};
+
+//Hands tiles out to worker processes over localhost sockets and merges what they send back.
+//Tiles held by a worker that dies go back in the queue for the others
+struct Coordinator {
+private:
+	RenderJob job;
+	int numWorkers;
+	std::string workerExecutable;
+	std::string sceneName;
+	std::string workerFlags;
+public:
+	//workerFlags go on every worker's command line as they are, e.g. " --env <path>" so workers light the scene alike
+	Coordinator(RenderJob job, int numWorkers, std::string workerExecutable, std::string sceneName = "default", std::string workerFlags = "") :
+		job(job),
+		numWorkers(numWorkers),
+		workerExecutable(std::move(workerExecutable)),
+		sceneName(std::move(sceneName)),
+		workerFlags(std::move(workerFlags))
+	{}
+
+	//Spawns the workers as "<workerExecutable> --worker <port> --scene <sceneName><workerFlags>" and blocks until every tile is back
+	Image render() const;
+};
+
+//Renders whatever tiles the coordinator on port asks for until it says to stop. Every tile is seeded by its position,
+//so its noise is independent of every other tile's whichever worker renders it. cache is optional and learns only
+//from this worker's tiles
+void runWorker(uint16_t port, std::shared_ptr<Scene> scene, RadianceCache* cache = nullptr);
@@ -0,0 +1,178 @@
+#include "EnvironmentMap.h"
+#include "Film.h"
+#include "Material.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+EnvironmentMap::EnvironmentMap(int width, int height, std::vector<Vec3f> texels) :
+	width(width),
+	height(height),
+	texels(std::move(texels))
+{
+	if (width <= 0 || height <= 0 || this->texels.size() != (size_t)width * height)
+		throw "Environment map size does not match its texels";
+
+	std::vector<float> rowWeights(height);
+	std::vector<float> weights(width);
+	columns.reserve(height);
+	for (int y = 0; y < height; y++) {
+		float sinTheta = std::sin((y + 0.5f) / height * PI); //Rows near the poles cover less solid angle
+		float rowSum = 0;
+		for (int x = 0; x < width; x++) {
+			weights[x] = std::max(0.0f, luminance(this->texels[(size_t)y * width + x])) * sinTheta;
+			rowSum += weights[x];
+		}
+		rowWeights[y] = rowSum;
+		columns.emplace_back(weights);
+	}
+	rows = AliasTable(rowWeights);
+}
+
+size_t EnvironmentMap::texelIndex(const Vec3f& dir) const {
+	float length = dir.length();
+	float cosTheta = std::max(-1.0f, std::min(1.0f, dir.y / length));
+	float u = 0.5f + std::atan2(dir.x, -dir.z) / (2 * PI);
+	float v = std::acos(cosTheta) / PI;
+	int x = std::min(std::max((int)(u * width), 0), width - 1);
+	int y = std::min(std::max((int)(v * height), 0), height - 1);
+	return (size_t)y * width + x;
+}
+
+Vec3f EnvironmentMap::lookup(const Vec3f& dir) const {
+	return texels[texelIndex(dir)];
+}
+
+Vec3f EnvironmentMap::sample(const Poi2f& u, Vec3f& dir, float& pdf) const {
+	float u0 = u[0], u1 = u[1];
+	uint32_t y = rows.sample(u0);
+	uint32_t x = columns[y].sample(u1);
+
+	//The remapped numbers place the direction uniformly within the texel
+	float theta = (y + u0) / height * PI;
+	float phi = ((x + u1) / width - 0.5f) * 2 * PI;
+	float sinTheta = std::sin(theta);
+	dir = Vec3f{ sinTheta * std::sin(phi), std::cos(theta), -sinTheta * std::cos(phi) };
+	pdf = sinTheta > 0 ? rows.getPmf(y) * columns[y].getPmf(x) * width * height / (2 * PI * PI * sinTheta) : 0;
+	return texels[(size_t)y * width + x];
+}
+
+float EnvironmentMap::pdf(const Vec3f& dir) const {
+	size_t i = texelIndex(dir);
+	uint32_t x = (uint32_t)(i % width), y = (uint32_t)(i / width);
+	float cosTheta = dir.y / dir.length();
+	float sinTheta = std::sqrt(std::max(0.0f, 1 - cosTheta * cosTheta));
+	return sinTheta > 0 ? rows.getPmf(y) * columns[y].getPmf(x) * width * height / (2 * PI * PI * sinTheta) : 0;
+}
+
+//Radiance's shared exponent pixels, see Greg Ward's Graphics Gems II chapter
+static Vec3f fromRgbe(const uint8_t rgbe[4]) {
+	if (rgbe[3] == 0)
+		return { 0, 0, 0 };
+	float scale = std::ldexp(1.0f, rgbe[3] - (128 + 8));
+	return Vec3f{ rgbe[0] + 0.5f, rgbe[1] + 0.5f, rgbe[2] + 0.5f } * scale;
+}
+
+static EnvironmentMap loadHdr(std::istream& stream) {
+	std::string line;
+	std::getline(stream, line);
+	if (line.compare(0, 2, "#?") != 0)
+		throw "Not a Radiance HDR file";
+	while (std::getline(stream, line) && !line.empty()) {
+		if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe")
+			throw "Only RGBE HDR files are supported";
+	}
+	std::getline(stream, line);
+	std::istringstream resolution(line);
+	std::string yAxis, xAxis;
+	int width = 0, height = 0;
+	resolution >> yAxis >> height >> xAxis >> width;
+	if (yAxis != "-Y" || xAxis != "+X" || width <= 0 || height <= 0)
+		throw "Only top to bottom, left to right HDR files are supported";
+
+	std::vector<Vec3f> texels((size_t)width * height);
+	std::vector<uint8_t> scanline((size_t)width * 4);
+	for (int y = 0; y < height; y++) {
+		uint8_t start[4];
+		if (!stream.read((char*)start, 4))
+			throw "HDR file ended early";
+		if (start[0] == 2 && start[1] == 2 && (start[2] << 8 | start[3]) == width && width >= 8 && width < 32768) {
+			//Run length encoded, one channel after another
+			for (int c = 0; c < 4; c++) {
+				for (int x = 0; x < width;) {
+					int count = stream.get();
+					if (count <= 0 || !stream)
+						throw "Bad HDR scanline";
+					if (count > 128) {
+						count -= 128;
+						int value = stream.get();
+						if (x + count > width || !stream)
+							throw "Bad HDR scanline";
+						for (; count > 0; count--)
+							scanline[(size_t)x++ * 4 + c] = (uint8_t)value;
+					} else {
+						if (x + count > width)
+							throw "Bad HDR scanline";
+						for (; count > 0; count--)
+							scanline[(size_t)x++ * 4 + c] = (uint8_t)stream.get();
+					}
+				}
+			}
+		} else { //Flat, the four bytes were the first pixel
+			std::copy(start, start + 4, scanline.begin());
+			stream.read((char*)scanline.data() + 4, (width - 1) * 4);
+		}
+		if (!stream)
+			throw "HDR file ended early";
+		for (int x = 0; x < width; x++)
+			texels[(size_t)y * width + x] = fromRgbe(&scanline[(size_t)x * 4]);
+	}
+	return EnvironmentMap(width, height, std::move(texels));
+}
+
+EnvironmentMap EnvironmentMap::load(const std::string& path) {
+	std::ifstream stream(path, std::ifstream::binary);
+	if (!stream)
+		throw "Could not open environment map";
+	std::string extension = path.substr(path.find_last_of('.') + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower(c); });
+	if (extension == "hdr")
+		return loadHdr(stream);
+	if (extension == "pfm") {
+		Film film = Film::readPfm(stream);
+		std::vector<Vec3f> texels(film.getWidth() * film.getHeight());
+		for (size_t y = 0; y < film.getHeight(); y++) {
+			for (size_t x = 0; x < film.getWidth(); x++)
+				texels[y * film.getWidth() + x] = film(x, y);
+		}
+		return EnvironmentMap((int)film.getWidth(), (int)film.getHeight(), std::move(texels));
+	}
+	throw "Environment maps must be .hdr or .pfm";
+}
+
+EnvironmentMap EnvironmentMap::makeSky(const Vec3f& sunDir, int width, int height) {
+	static constexpr float SUN_COS_RADIUS = 0.9994f; //About two degrees in radius
+	static constexpr float SUN_RADIANCE = 1000;
+	Vec3f sun = normalize(sunDir);
+	std::vector<Vec3f> texels((size_t)width * height);
+	for (int y = 0; y < height; y++) {
+		float theta = (y + 0.5f) / height * PI;
+		for (int x = 0; x < width; x++) {
+			float phi = ((x + 0.5f) / width - 0.5f) * 2 * PI;
+			Vec3f dir{ std::sin(theta) * std::sin(phi), std::cos(theta), -std::sin(theta) * std::cos(phi) };
+			Vec3f radiance;
+			if (dir.y > 0) { //Pale at the horizon, deep blue overhead
+				float t = std::sqrt(dir.y);
+				radiance = (1 - t) * Vec3f{ 0.8f, 0.85f, 0.9f } + t * Vec3f{ 0.2f, 0.35f, 0.75f };
+			} else {
+				radiance = Vec3f{ 0.15f, 0.13f, 0.1f };
+			}
+			if (dot(dir, sun) > SUN_COS_RADIUS)
+				radiance = Vec3f{ 1.0f, 0.95f, 0.85f } * SUN_RADIANCE;
+			texels[(size_t)y * width + x] = radiance;
+		}
+	}
+	return EnvironmentMap(width, height, std::move(texels));
+}
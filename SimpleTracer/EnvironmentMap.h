@@ -0,0 +1,47 @@
+#pragma once
+
+#include "AliasTable.h"
+#include "LinearAlg.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Light arriving from infinitely far away, stored as an equirectangular radiance map. The top row looks along +y, the
+//middle of the image along -z. Sampled in proportion to luminance times the solid angle of each texel, the texels
+//are treated as constant so sampling and lookup agree exactly
+struct EnvironmentMap {
+private:
+	int width;
+	int height;
+	std::vector<Vec3f> texels; //Row major, linear radiance
+	AliasTable rows; //Marginal over rows
+	std::vector<AliasTable> columns; //Conditional over each row's texels
+
+	size_t texelIndex(const Vec3f& dir) const;
+public:
+	//texels holds width * height values, row major from the top
+	EnvironmentMap(int width, int height, std::vector<Vec3f> texels);
+
+	//Radiance .hdr (RGBE, flat or run length encoded) or little endian color .pfm, picked by extension. Throws on failure
+	static EnvironmentMap load(const std::string& path);
+
+	//Gradient sky over dim ground with a small bright sun towards sunDir, for scenes without an image at hand
+	static EnvironmentMap makeSky(const Vec3f& sunDir, int width = 512, int height = 256);
+
+	int getWidth() const {
+		return width;
+	}
+
+	int getHeight() const {
+		return height;
+	}
+
+	//Radiance arriving along -dir, i.e. seen looking towards dir. dir need not be unit length
+	Vec3f lookup(const Vec3f& dir) const;
+
+	//Picks a unit direction towards the environment, returns the radiance from there and its pdf with respect to solid angle
+	Vec3f sample(const Poi2f& u, Vec3f& dir, float& pdf) const;
+
+	//Solid angle pdf of sample returning dir
+	float pdf(const Vec3f& dir) const;
+};
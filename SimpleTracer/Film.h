@@ -0,0 +1,126 @@
+#pragma once
+
+#include "LinearAlg.h"
+#include "Image.h"
+#include "Tile.h"
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <string>
+
+//Gamma 2 and clamp linear radiance into a displayable pixel
+inline Image::Pixel toPixel(const Vec3f& c) {
+	Vec3f g{ std::sqrt(std::min(c.x, 1.0f)), std::sqrt(std::min(c.y, 1.0f)), std::sqrt(std::min(c.z, 1.0f)) };
+	return Image::Pixel(g * 255);
+}
+
+//Linear float framebuffer that tiles are merged into before tonemapping to an Image
+struct Film {
+private:
+	std::vector<Vec3f> pixelBuffer;
+	size_t width;
+	size_t height;
+public:
+	Film(size_t width, size_t height) :
+		pixelBuffer(width * height, Vec3f{ 0, 0, 0 }),
+		width(width),
+		height(height)
+	{}
+
+	size_t getWidth() const {
+		return width;
+	}
+
+	size_t getHeight() const {
+		return height;
+	}
+
+	Vec3f operator()(int x, int y) const {
+		return pixelBuffer[y * width + x];
+	}
+
+	Vec3f& operator()(int x, int y) {
+		return pixelBuffer[y * width + x];
+	}
+
+	//Data holds tile.getArea() row-major values
+	void putTile(const Tile& tile, const Vec3f* data) {
+		for (int y = tile.y0; y < tile.y1; y++) {
+			for (int x = tile.x0; x < tile.x1; x++) {
+				(*this)(x, y) = *data++;
+			}
+		}
+	}
+
+	//Like putTile but sums weight * data into what is already there, for accumulating passes
+	void addTile(const Tile& tile, const Vec3f* data, float weight = 1) {
+		for (int y = tile.y0; y < tile.y1; y++) {
+			for (int x = tile.x0; x < tile.x1; x++) {
+				(*this)(x, y) += *data++ * weight;
+			}
+		}
+	}
+
+	Film& operator+=(const Film& rhs) {
+		for (size_t i = 0; i < pixelBuffer.size(); i++)
+			pixelBuffer[i] += rhs.pixelBuffer[i];
+		return *this;
+	}
+
+	void clear() {
+		std::fill(pixelBuffer.begin(), pixelBuffer.end(), Vec3f{ 0, 0, 0 });
+	}
+
+	//Writes width * height row-major pixels, each scaled by scale before tonemapping
+	void tonemap(Image::Pixel* out, float scale = 1) const {
+		for (const Vec3f& c : pixelBuffer) {
+			*out++ = toPixel(c * scale);
+		}
+	}
+
+	//Little endian PFM, rows bottom to top as the format wants. Keeps full float radiance, for reference renders
+	void writePfm(std::ostream& stream, float scale = 1) const {
+		stream << "PF\n" << width << " " << height << "\n-1.0\n";
+		for (size_t y = height; y-- > 0;) {
+			for (size_t x = 0; x < width; x++) {
+				Vec3f c = (*this)(x, y) * scale;
+				float rgb[3] = { c.x, c.y, c.z };
+				stream.write((const char*)rgb, sizeof(rgb));
+			}
+		}
+	}
+
+	//Reads what writePfm writes, throws on anything else
+	static Film readPfm(std::istream& stream) {
+		std::string magic;
+		size_t width, height;
+		float endianness;
+		stream >> magic >> width >> height >> endianness;
+		if (!stream || magic != "PF" || endianness >= 0)
+			throw "Expected a little endian color PFM";
+		stream.get(); //Single whitespace before the data
+		Film film(width, height);
+		for (size_t y = height; y-- > 0;) {
+			for (size_t x = 0; x < width; x++) {
+				float rgb[3];
+				stream.read((char*)rgb, sizeof(rgb));
+				film(x, y) = Vec3f{ rgb[0], rgb[1], rgb[2] };
+			}
+		}
+		if (!stream)
+			throw "PFM ended early";
+		return film;
+	}
+
+	Image toImage(float scale = 1) const {
+		Image img(width, height);
+		for (size_t y = 0; y < height; y++) {
+			for (size_t x = 0; x < width; x++) {
+				img(x, y) = toPixel((*this)(x, y) * scale);
+			}
+		}
+		return img;
+	}
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+//Which objects and materials some set of paths depended on, as one bit each. Grows to fit the highest index
+//added and keeps its memory across clear, so refilling one per tile does not allocate after the first frame
+struct Footprint {
+private:
+	std::vector<uint64_t> objectBits;
+	std::vector<uint64_t> materialBits;
+	int maxDepth = std::numeric_limits<int>::max();
+
+	static void set(std::vector<uint64_t>& bits, uint32_t i) {
+		if (i / 64 >= bits.size())
+			bits.resize(i / 64 + 1, 0);
+		bits[i / 64] |= (uint64_t)1 << (i % 64);
+	}
+
+	static bool test(const std::vector<uint64_t>& bits, uint32_t i) {
+		return i / 64 < bits.size() && (bits[i / 64] >> (i % 64) & 1) != 0;
+	}
+public:
+	//Renderers only record path vertices up to this many bounces past the camera hit
+	int getMaxDepth() const {
+		return maxDepth;
+	}
+
+	void setMaxDepth(int maxDepth) {
+		this->maxDepth = maxDepth;
+	}
+
+	void addObject(uint32_t object) {
+		set(objectBits, object);
+	}
+
+	void addMaterial(uint32_t material) {
+		set(materialBits, material);
+	}
+
+	bool hasObject(uint32_t object) const {
+		return test(objectBits, object);
+	}
+
+	bool hasMaterial(uint32_t material) const {
+		return test(materialBits, material);
+	}
+
+	void clear() {
+		std::fill(objectBits.begin(), objectBits.end(), 0);
+		std::fill(materialBits.begin(), materialBits.end(), 0);
+	}
+};
@@ -0,0 +1,77 @@
+#include "FrameSink.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+PipeFrameSink::PipeFrameSink(FILE* file) :
+	file(file)
+{
+#ifdef _WIN32
+	_setmode(_fileno(file), _O_BINARY); //Text mode would turn every 0x0A byte into 0x0D 0x0A
+#endif
+}
+
+void PipeFrameSink::publish(const Image::Pixel* frame, int width, int height, int) {
+	fwrite(frame, sizeof(Image::Pixel), (size_t)width * height, file);
+	fflush(file);
+}
+
+SharedMemoryFrameSink::SharedMemoryFrameSink(const std::string& name, int width, int height) :
+	name(name),
+	size(sizeof(SharedFrameHeader) + sizeof(Image::Pixel) * width * height),
+	header(nullptr)
+{
+#ifdef _WIN32
+	mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)size, name.c_str());
+	if (mapping == nullptr)
+		throw "Could not create shared memory";
+	header = (SharedFrameHeader*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (header == nullptr)
+		throw "Could not map shared memory";
+#else
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+	if (fd < 0)
+		throw "Could not create shared memory";
+	if (ftruncate(fd, size) != 0) {
+		::close(fd);
+		throw "Could not size shared memory";
+	}
+	void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		throw "Could not map shared memory";
+	header = (SharedFrameHeader*)p;
+#endif
+	header->magic = SharedFrameHeader::MAGIC;
+	header->width = width;
+	header->height = height;
+	header->passes = 0;
+	header->sequence.store(0);
+}
+
+SharedMemoryFrameSink::~SharedMemoryFrameSink() {
+#ifdef _WIN32
+	UnmapViewOfFile(header);
+	CloseHandle(mapping);
+#else
+	munmap(header, size);
+	shm_unlink(name.c_str());
+#endif
+}
+
+void SharedMemoryFrameSink::publish(const Image::Pixel* frame, int width, int height, int passes) {
+	header->sequence.fetch_add(1, std::memory_order_acq_rel);
+	header->passes = passes;
+	std::memcpy(reinterpret_cast<char*>(header) + sizeof(SharedFrameHeader), frame, sizeof(Image::Pixel) * width * height);
+	header->sequence.fetch_add(1, std::memory_order_release);
+}
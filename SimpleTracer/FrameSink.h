@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Image.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+static_assert(sizeof(Image::Pixel) == 3, "Frames are published as packed 8-bit RGB");
+
+//Somewhere to publish preview frames to, called once per finished pass
+struct FrameSink {
+	//Frame holds width * height row-major pixels
+	virtual void publish(const Image::Pixel* frame, int width, int height, int passes) = 0;
+	virtual ~FrameSink() {}
+};
+
+//Raw rgb24 frames back to back with no headers, so a video player can read them straight off the pipe:
+//SimpleTracer --preview pipe | ffplay -f rawvideo -pixel_format rgb24 -video_size 400x225 -
+struct PipeFrameSink : public FrameSink {
+private:
+	FILE* file;
+public:
+	explicit PipeFrameSink(FILE* file);
+
+	void publish(const Image::Pixel* frame, int width, int height, int passes);
+};
+
+//Lives at the start of the shared memory block, followed by width * height row-major pixels
+struct SharedFrameHeader {
+	static constexpr uint32_t MAGIC = 0x56505453; //"STPV"
+
+	uint32_t magic;
+	uint32_t width;
+	uint32_t height;
+	uint32_t passes;
+	std::atomic<uint32_t> sequence; //Odd while a frame is being written, readers retry if it changed under them
+};
+
+//Keeps the latest frame in a named shared memory block that viewers in other processes can map
+struct SharedMemoryFrameSink : public FrameSink {
+private:
+	std::string name;
+	size_t size;
+	SharedFrameHeader* header;
+#ifdef _WIN32
+	void* mapping;
+#endif
+public:
+	SharedMemoryFrameSink(const std::string& name, int width, int height);
+
+	SharedMemoryFrameSink(const SharedMemoryFrameSink&) = delete;
+
+	SharedMemoryFrameSink& operator=(const SharedMemoryFrameSink&) = delete;
+
+	~SharedMemoryFrameSink();
+
+	void publish(const Image::Pixel* frame, int width, int height, int passes);
+};
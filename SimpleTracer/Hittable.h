@@ -5,6 +5,30 @@
 
 
 struct Hittable {
-	virtual bool intersect(const Ray& r, Intersection* insect = nullptr) const = 0;
+	//Closest hit test, shortens r.tMax and records only what finalize needs. Inner loops should use this
+	virtual bool intersect(const Ray& r, Hit& hit) const = 0;
+
+	//Builds the full surface data for the hit that intersect settled on, r is the ray it was found with
+	virtual void finalize(const Ray& r, const Hit& hit, Intersection& insect) const = 0;
+
+	//Any hit test within [r.tMin, r.tMax], returns as soon as anything is found and never computes shading data
+	virtual bool occluded(const Ray& r) const = 0;
+
+	//For shadow rays, is anything in the way closer than tMax along r
+	bool occluded(const Ray& r, float tMax) const {
+		Ray shadow = r;
+		shadow.tMax = tMax;
+		return occluded(shadow);
+	}
+
+	bool intersect(const Ray& r, Intersection* insect = nullptr) const {
+		Hit hit;
+		if (!intersect(r, hit))
+			return false;
+		if (insect != nullptr)
+			finalize(r, hit, *insect);
+		return true;
+	}
+
 	virtual ~Hittable() {}
 };
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "LinearAlg.h"
 #include <vector>
+#include <istream>
+#include <string>
 
 struct Image {
 	using Pixel = Vec3<uint8_t>;
@@ -64,6 +66,40 @@ public:
 		}
 	}
 
+	//Binary P6 with maxval 255, throws on anything else
+	static Image readPpm(std::istream& stream) {
+		std::string magic;
+		size_t width, height;
+		int maxval;
+		stream >> magic;
+		auto skipComments = [&stream]() {
+			while (stream >> std::ws && stream.peek() == '#') {
+				std::string comment;
+				std::getline(stream, comment);
+			}
+		};
+		skipComments();
+		stream >> width;
+		skipComments();
+		stream >> height;
+		skipComments();
+		stream >> maxval;
+		stream.get(); //Single whitespace before the pixel data
+		if (!stream || magic != "P6" || maxval != 255)
+			throw "Only binary 8-bit ppm images can be read";
+
+		Image img(width, height);
+		for (size_t y = 0; y < height; ++y) {
+			for (size_t x = 0; x < width; ++x) {
+				Pixel& p = img.getPixel(x, y);
+				stream.read((char*) p.data, sizeof(p.data));
+			}
+		}
+		if (!stream)
+			throw "Ppm image ended early";
+		return img;
+	}
+
 	friend std::ostream& operator<<(std::ostream& lhs, const Image& rhs) {
 		rhs.writePlainPpm(lhs);
 		return lhs;
@@ -0,0 +1,97 @@
+#include "IncrementalRender.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+
+IncrementalRender::IncrementalRender(const Camera& camera, std::shared_ptr<Scene> scene, const Transform& camToWorld, int footprintDepth) :
+	camera(camera),
+	scene(scene),
+	camToWorld(camToWorld),
+	tiles(makeTiles(camera.getResolution())),
+	footprints(tiles.size()),
+	stale(tiles.size(), true),
+	film(camera.getResolution().x, camera.getResolution().y)
+{
+	for (Footprint& footprint : footprints)
+		footprint.setMaxDepth(footprintDepth);
+}
+
+//Projects the box's corners and marks every tile their screen rectangle overlaps. A corner behind the camera
+//could be anywhere on screen, so that marks everything
+void IncrementalRender::markCovered(const Bounds3f& worldBounds) {
+	if (worldBounds.isEmpty())
+		return;
+	Vec2i resolution = camera.getResolution();
+	ViewingFrustum frustum{ resolution, camera.getVerticalFov() };
+	Transform worldToCam = inv(camToWorld);
+	float x0 = (float)resolution.x, y0 = (float)resolution.y, x1 = 0, y1 = 0;
+	for (int corner = 0; corner < 8; corner++) {
+		Poi3f p{ corner & 1 ? worldBounds.max.x : worldBounds.min.x, corner & 2 ? worldBounds.max.y : worldBounds.min.y,
+			corner & 4 ? worldBounds.max.z : worldBounds.min.z };
+		Poi2f ndc;
+		if (!frustum.project(worldToCam(p), ndc)) {
+			invalidateAll();
+			return;
+		}
+		x0 = std::min(x0, ndc.x * resolution.x);
+		y0 = std::min(y0, ndc.y * resolution.y);
+		x1 = std::max(x1, ndc.x * resolution.x);
+		y1 = std::max(y1, ndc.y * resolution.y);
+	}
+	for (size_t i = 0; i < tiles.size(); i++) {
+		const Tile& tile = tiles[i];
+		if (tile.x0 <= x1 && tile.x1 >= x0 && tile.y0 <= y1 && tile.y1 >= y0)
+			stale[i] = true;
+	}
+}
+
+void IncrementalRender::materialChanged(uint32_t material) {
+	//Emission reaches tiles through light sampling too, which only records the emitting object
+	std::vector<uint32_t> users;
+	for (uint32_t n = 0; n < scene->getNumObjects(); n++) {
+		if (scene->getObject(n).getMaterial().index == material)
+			users.push_back(n);
+	}
+	for (size_t i = 0; i < tiles.size(); i++) {
+		if (footprints[i].hasMaterial(material))
+			stale[i] = true;
+		for (uint32_t object : users)
+			stale[i] = stale[i] || footprints[i].hasObject(object);
+	}
+}
+
+void IncrementalRender::objectMoved(uint32_t object) {
+	for (size_t i = 0; i < tiles.size(); i++) {
+		if (footprints[i].hasObject(object))
+			stale[i] = true;
+	}
+	markCovered(scene->getObject(object).worldBound());
+}
+
+void IncrementalRender::invalidateAll() {
+	std::fill(stale.begin(), stale.end(), true);
+}
+
+size_t IncrementalRender::render() {
+	TRACE_SCOPE("Incremental render");
+	std::vector<uint32_t> staleTiles;
+	for (uint32_t i = 0; i < tiles.size(); i++) {
+		if (stale[i])
+			staleTiles.push_back(i);
+	}
+
+	ThreadPool& pool = getThreadPool();
+	std::vector<std::vector<Vec3f>> tileBuffers(pool.getNumThreads(), std::vector<Vec3f>(TILE_SIZE * TILE_SIZE));
+	SharedOrigin origin; //Objects may have moved since the last call
+	camera.prepareOrigin(camToWorld, origin);
+	expectTiles(staleTiles.size());
+	pool.parallelFor(staleTiles.size(), [&](size_t i, size_t thread) {
+		uint32_t t = staleTiles[i];
+		footprints[t].clear();
+		camera.renderTile(camToWorld, tiles[t], tileBuffers[thread].data(), &footprints[t], &origin);
+		film.putTile(tiles[t], tileBuffers[thread].data());
+	});
+	for (uint32_t t : staleTiles) //Packed bits, so not from the workers
+		stale[t] = false;
+	return staleTiles.size();
+}
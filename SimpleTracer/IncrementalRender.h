@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Camera.h"
+#include "Film.h"
+#include "Footprint.h"
+#include "Image.h"
+#include "Scene.h"
+#include "Tile.h"
+#include "Transform.h"
+#include <memory>
+#include <vector>
+
+//Keeps a frame between scene edits and re-renders only the tiles an edit can reach. Every tile remembers the objects
+//its paths hit, lit themselves with or were shadowed by, and the materials they shaded; an edit marks the tiles whose
+//footprint holds what changed, and the rest keep their samples. Moved objects also mark the tiles their new bounds
+//cover on screen. Footprints stop footprintDepth bounces past the camera hit: deep paths touch nearly everything, so
+//recording them all would invalidate nearly every tile, at the price of missing faint indirect changes. Light an object
+//sends to or blocks from tiles that never touched it before is missed too, until those tiles are rendered again for
+//another reason. Not meant for renderers with a radiance cache or path guide, which carry light between tiles
+//without showing up in any footprint
+struct IncrementalRender {
+private:
+	Camera camera;
+	std::shared_ptr<Scene> scene;
+	Transform camToWorld;
+	std::vector<Tile> tiles;
+	std::vector<Footprint> footprints; //Per tile, from when it was last rendered
+	std::vector<bool> stale; //Per tile
+	Film film;
+
+	void markCovered(const Bounds3f& worldBounds);
+public:
+	static constexpr int DEFAULT_FOOTPRINT_DEPTH = 1; //Camera hits, their first bounce and the light both sampled
+
+	//camera must render scene
+	IncrementalRender(const Camera& camera, std::shared_ptr<Scene> scene, const Transform& camToWorld = Transform(),
+		int footprintDepth = DEFAULT_FOOTPRINT_DEPTH);
+
+	//Call after changing the material, e.g. its color or emission
+	void materialChanged(uint32_t material);
+
+	//Call after moving the object and updating the scene
+	void objectMoved(uint32_t object);
+
+	//Everything, e.g. after the camera moved
+	void invalidateAll();
+
+	//Re-renders the stale tiles, all of them the first time, and returns how many there were
+	size_t render();
+
+	size_t getNumTiles() const {
+		return tiles.size();
+	}
+
+	Image toImage() const {
+		return film.toImage();
+	}
+};
@@ -1,8 +1,20 @@
 #pragma once
 
 #include "LinearAlg.h"
+#include <cstdint>
 
-struct Material;
+struct Object;
+
+//What traversal records for the closest hit so far, just enough for finalize to rebuild the full Intersection
+struct Hit {
+	//Ray parameter in the space of the shape that was hit
+	float t;
+
+	//Object that was hit, and the primitive within its shape with barycentrics on it
+	const Object* object;
+	uint32_t primId;
+	Poi2f b;
+};
 
 struct Intersection {
 	//Outgoing ray direction
@@ -16,5 +28,6 @@ struct Intersection {
 	Poi2f uv;
 	Vec3f dpdu, dpdv;
 
-	Material* m;
+	//Index into the scene's material table
+	uint32_t materialId;
 };
\ No newline at end of file
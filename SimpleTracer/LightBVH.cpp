@@ -0,0 +1,121 @@
+#include "LightBVH.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+
+static float safeSqrt(float x) {
+	return std::sqrt(std::max(0.0f, x));
+}
+
+//cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+static float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+	return cosA > cosB ? 1 : cosA * cosB + sinA * sinB;
+}
+
+static float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+	return cosA > cosB ? 0 : sinA * cosB - cosA * sinB;
+}
+
+float LightBounds::importance(const Poi3f& p, const Norm3f& n) const {
+	Poi3f center = bounds.centroid();
+	float radius = 0.5f * bounds.diagonal().length();
+	float dist2 = distanceSq(p, center);
+	float d2 = std::max(dist2, radius); //Keeps points near or inside the bounds from blowing up
+
+	//Angle between the cone axis and p, less the spread of the cone and of the box as seen from p
+	Vec3f wi = normalize(p - center);
+	float cosThetaW = std::abs(dot(normals.w, wi));
+	float sinThetaW = safeSqrt(1 - cosThetaW * cosThetaW);
+	float cosThetaB = dist2 > radius * radius ? safeSqrt(1 - radius * radius / dist2) : -1;
+	float sinThetaB = safeSqrt(1 - cosThetaB * cosThetaB);
+	float sinThetaO = safeSqrt(1 - normals.cosTheta * normals.cosTheta);
+	float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, normals.cosTheta);
+	float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, normals.cosTheta);
+	float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+	if (cosThetaP <= cosThetaE)
+		return 0;
+
+	//Same for the angle the lights make with the surface normal
+	float cosThetaI = std::abs(dot(wi, n));
+	float sinThetaI = safeSqrt(1 - cosThetaI * cosThetaI);
+	float cosThetaPI = cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+	return std::max(0.0f, power * cosThetaP * cosThetaPI / d2);
+}
+
+LightBounds merge(const LightBounds& a, const LightBounds& b) {
+	if (a.power == 0)
+		return b;
+	if (b.power == 0)
+		return a;
+	return { merge(a.bounds, b.bounds), a.power + b.power, merge(a.normals, b.normals), std::min(a.cosThetaE, b.cosThetaE) };
+}
+
+void LightBVH::build(const std::vector<LightBounds>& lights) {
+	TRACE_SCOPE("Light BVH build", "lights", (int64_t)lights.size());
+	CounterScope counters(PHASE_BUILD);
+	nodes.clear();
+	std::vector<std::pair<LightBounds, uint32_t>> sorted;
+	for (uint32_t i = 0; i < lights.size(); i++) {
+		if (lights[i].power > 0)
+			sorted.push_back({ lights[i], i });
+	}
+	if (sorted.empty())
+		return;
+	nodes.reserve(2 * sorted.size());
+	buildRecursive(sorted, 0, sorted.size());
+}
+
+uint32_t LightBVH::buildRecursive(std::vector<std::pair<LightBounds, uint32_t>>& lights, size_t begin, size_t end) {
+	uint32_t index = (uint32_t)nodes.size();
+	nodes.emplace_back();
+	if (end - begin == 1) {
+		nodes[index] = { lights[begin].first, lights[begin].second, true };
+		return index;
+	}
+
+	//Median split along the widest spread of centers keeps the tree, and so sampling, O(log n) deep
+	Bounds3f centroidBounds;
+	for (size_t i = begin; i < end; i++)
+		centroidBounds = merge(centroidBounds, lights[i].first.bounds.centroid());
+	int axis = centroidBounds.maxExtent();
+	size_t mid = (begin + end) / 2;
+	std::nth_element(lights.begin() + begin, lights.begin() + mid, lights.begin() + end,
+		[axis](const std::pair<LightBounds, uint32_t>& a, const std::pair<LightBounds, uint32_t>& b) {
+			return a.first.bounds.centroid()[axis] < b.first.bounds.centroid()[axis];
+		});
+
+	uint32_t first = buildRecursive(lights, begin, mid);
+	uint32_t second = buildRecursive(lights, mid, end);
+	nodes[index] = { merge(nodes[first].bounds, nodes[second].bounds), second, false };
+	return index;
+}
+
+bool LightBVH::sample(const Poi3f& p, const Norm3f& n, float u, uint32_t& light, float& pmf) const {
+	if (nodes.empty() || nodes[0].bounds.importance(p, n) == 0)
+		return false;
+
+	uint32_t current = 0;
+	pmf = 1;
+	while (!nodes[current].isLeaf) {
+		uint32_t children[2] = { current + 1, nodes[current].offset };
+		float first = nodes[children[0]].bounds.importance(p, n);
+		float second = nodes[children[1]].bounds.importance(p, n);
+		if (first == 0 && second == 0)
+			return false;
+
+		//Reuse u for every level by rescaling the part of it that picked the child
+		float pFirst = first / (first + second);
+		if (u < pFirst) {
+			u = std::min(u / pFirst, 0.99999994f);
+			pmf *= pFirst;
+			current = children[0];
+		} else {
+			u = std::min((u - pFirst) / (1 - pFirst), 0.99999994f);
+			pmf *= 1 - pFirst;
+			current = children[1];
+		}
+	}
+	light = nodes[current].offset;
+	return true;
+}
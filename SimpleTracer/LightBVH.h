@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Bounds.h"
+#include "LinearAlg.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//What the light hierarchy knows about a group of emitters: where they are, how much they emit and which way.
+//Emission is two sided, as hits pick up a material's light whichever side they land on
+struct LightBounds {
+	Bounds3f bounds;
+	float power; //Emitted luminance times area, only ever compared against other lights
+	DirectionCone normals;
+	float cosThetaE; //How far past the normals emission spreads, pi / 2 for diffuse emitters
+
+	//Conservative guess at how much these lights contribute at p on a surface facing n, 0 when they cannot reach it
+	float importance(const Poi3f& p, const Norm3f& n) const;
+
+	friend LightBounds merge(const LightBounds& a, const LightBounds& b);
+};
+
+//Binary tree over emitters. A shading point descends it picking children by importance, so a light is chosen
+//roughly in proportion to its contribution in O(log n) instead of looking at every light
+struct LightBVH {
+private:
+	struct Node {
+		LightBounds bounds;
+		uint32_t offset; //Leaf: the light. Interior: index of the second child, the first follows the node
+		bool isLeaf;
+	};
+
+	std::vector<Node> nodes;
+
+	uint32_t buildRecursive(std::vector<std::pair<LightBounds, uint32_t>>& lights, size_t begin, size_t end);
+public:
+	//Lights are referred to by their index in lights from then on
+	void build(const std::vector<LightBounds>& lights);
+
+	bool isEmpty() const {
+		return nodes.empty();
+	}
+
+	//False when no light can reach p. Otherwise light is the chosen index and pmf the probability it had of being chosen
+	bool sample(const Poi3f& p, const Norm3f& n, float u, uint32_t& light, float& pmf) const;
+};
@@ -408,6 +408,14 @@ struct Vector : public VectorData<Size, Type> {
 		return a * b;
 	}
 
+	//Component-wise product, operator* is the dot product
+	friend Vector hadamard(const Vector& a, const Vector& b) {
+		Vector result = Vector();
+		for (size_t i = 0; i < Size; i++)
+			result.data[i] = a.data[i] * b.data[i];
+		return result;
+	}
+
 	friend Type absDot(const Vector& a, const Vector& b) {
 		return std::abs(dot(a, b));
 	}
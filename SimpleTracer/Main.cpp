@@ -1,38 +1,229 @@
 #include <iostream>
 #include <fstream>
+#include <string>
 #include "LinearAlg.h"
 #include "Camera.h"
 #include "Image.h"
-#include "Sphere.h"
-#include "Object.h"
-#include "Material.h"
 #include "Timer.h"
 #include "Intersection.h"
 #include "Scene.h"
+#include "Scenes.h"
+#include "SceneBuilder.h"
+#include "Sphere.h"
+#include "Distributed.h"
+#include "Preview.h"
+#include "FrameSink.h"
+#include "Animation.h"
+#include "Numa.h"
+#include "PathGuide.h"
+#include "RadianceCache.h"
+#include "BVH.h"
+#include "Convergence.h"
+#include "Trace.h"
+#include "PerfCounters.h"
+#include "Telemetry.h"
+#include "EnvironmentMap.h"
+#include "Metropolis.h"
+#include "AllocationCounter.h"
+#include "IncrementalRender.h"
+#include "Random.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+static int run(int argc, char** argv) {
+	std::string mode = argc > 1 ? argv[1] : "";
+	std::string sceneName = "default"; //"--scene <name>" anywhere on the command line, see makeScene
+	bool sceneGiven = false;
+	std::string label = "current"; //"--label <name>" tags --converge rows, e.g. with the commit they came from
+	std::string tracePath; //"--trace <path>" anywhere writes a Chrome trace of the run there, see Trace.h
+	std::unique_ptr<RadianceCache> cache; //"--cache <cell size>" anywhere, see RadianceCache.h
+	std::string environmentPath; //"--env <path.hdr|pfm>" lights the main render with an equirectangular map, see EnvironmentMap.h
+	int metricsPort = -1; //"--metrics <port>" anywhere serves live progress on 127.0.0.1, see Telemetry.h
+	std::string countersPath; //"--counters <path>" anywhere writes CPU counters per render phase there as csv, see PerfCounters.h
+	int numThreads = 0; //"--threads <n>" anywhere sizes the thread pool instead of the machine
+	for (int i = 1; i + 1 < argc; i++) {
+		if (std::string(argv[i]) == "--scene") {
+			sceneName = argv[i + 1];
+			sceneGiven = true;
+		}
+		if (std::string(argv[i]) == "--label")
+			label = argv[i + 1];
+		if (std::string(argv[i]) == "--cache")
+			cache = std::make_unique<RadianceCache>(std::stof(argv[i + 1]));
+		if (std::string(argv[i]) == "--trace")
+			tracePath = argv[i + 1];
+		if (std::string(argv[i]) == "--env")
+			environmentPath = argv[i + 1];
+		if (std::string(argv[i]) == "--metrics")
+			metricsPort = std::stoi(argv[i + 1]);
+		if (std::string(argv[i]) == "--counters")
+			countersPath = argv[i + 1];
+		if (std::string(argv[i]) == "--threads")
+			numThreads = std::stoi(argv[i + 1]);
+	}
+	if (mode == "--check-threads" && numThreads < 2)
+		numThreads = 4; //Worth checking even on a one cpu box, the threads still interleave
+	if (numThreads > 0)
+		setThreadPoolSize((size_t)numThreads);
+	TraceSession traceSession(tracePath);
+	CounterSession counterSession(countersPath);
+	nameTraceThread("Main");
+	std::unique_ptr<MetricsServer> metrics;
+	if (metricsPort >= 0) {
+		metrics = std::make_unique<MetricsServer>((uint16_t)metricsPort);
+		std::cerr << "Serving metrics on http://127.0.0.1:" << metrics->getPort() << "/metrics" << std::endl;
+	}
+	auto loadScene = [&] {
+		std::shared_ptr<Scene> scene = makeScene(sceneName);
+		if (!environmentPath.empty())
+			scene->setEnvironment(std::make_shared<EnvironmentMap>(EnvironmentMap::load(environmentPath)));
+		return scene;
+	};
+	if (mode == "--worker" && argc > 2) { //Spawned by a coordinator, see Distributed.h
+		runWorker((uint16_t)std::stoi(argv[2]), loadScene(), cache.get());
+		return 0;
+	}
+	int numWorkers = (mode == "--distributed" && argc > 2) ? std::stoi(argv[2]) : 0;
+	std::string workerFlags; //Everything that changes what a worker renders goes along with the scene
+	if (!environmentPath.empty())
+		workerFlags += " --env \"" + environmentPath + "\"";
+	if (cache)
+		workerFlags += " --cache " + std::to_string(cache->getCellSize());
+	if (mode == "--preview") { //Quarter resolution, one sample a pass, until killed
+		std::string output = argc > 2 && argv[2][0] != '-' ? argv[2] : "pipe";
+		Renderer r{ loadScene() };
+		r.setRadianceCache(cache.get());
+		Camera c{ { 80 * 5, 45 * 5 }, 90, r, 1 };
+		std::unique_ptr<FrameSink> sink;
+		if (output == "shm") {
+#ifdef _WIN32
+			sink = std::make_unique<SharedMemoryFrameSink>("Local\\SimpleTracerPreview", 80 * 5, 45 * 5);
+#else
+			sink = std::make_unique<SharedMemoryFrameSink>("/SimpleTracerPreview", 80 * 5, 45 * 5);
+#endif
+		} else {
+			sink = std::make_unique<PipeFrameSink>(stdout);
+		}
+		std::cerr << "Previewing " << 80 * 5 << "x" << 45 * 5 << " rgb24 to " << output << std::endl;
+		Preview{ c, *sink }.run();
+		return 0;
+	}
+
+	if (mode == "--bvh-bench") { //Builds over random triangle sized boxes, the argument is millions of primitives
+		float millions = argc > 2 ? std::stof(argv[2]) : 1;
+		std::vector<Bounds3f> prims((size_t)(millions * 1000000));
+		for (Bounds3f& b : prims) {
+			Poi3f p{ randomF() * 100, randomF() * 100, randomF() * 100 };
+			b = Bounds3f(p, p + Vec3f{ randomF(), randomF(), randomF() } * 0.1f);
+		}
+		BVH bvh;
+		for (BVH::BuildMethod method : { BVH::BuildMethod::BinnedSAH, BVH::BuildMethod::Morton }) {
+			bvh.build(prims, method);
+			std::cout << (method == BVH::BuildMethod::Morton ? "Morton: " : "Binned SAH: ") << bvh.getBuildSeconds() << "s, "
+				<< bvh.getBuildSeconds() / millions << "s per million, SAH cost " << bvh.sahCost() << std::endl;
+		}
+		return 0;
+	}
+
+	if (mode == "--check-transforms") { //Fails unless objects placed by a scale report hits at the t their rays reach them
+		int numFailures = 0;
+		for (float k : { 2.0f, 0.5f }) {
+			SceneBuilder builder;
+			MaterialHandle material = builder.addMaterial(Material{ Vec3f{ 1, 1, 1 } });
+			Poi3f quad[] = { { -1, -1, 0 }, { 1, -1, 0 }, { 1, 1, 0 }, { -1, 1, 0 } };
+			int indexes[] = { 0, 1, 2, 0, 2, 3 };
+			builder.addObject(Transform::Translation(0, 0, -10)(Transform::Scale(k)), builder.addShape<Sphere>(Poi3f{ 0, 0, 0 }, 1.0f), material);
+			builder.addObject(Transform::Translation(0, 0, -14), builder.addShape<Sphere>(Poi3f{ 0, 0, 0 }, 1.0f), material);
+			builder.addObject(Transform::Translation(5, 0, -20)(Transform::Scale(k)), builder.addTriangleMesh(quad, 4, indexes, 2), material);
+			std::shared_ptr<Scene> checked = builder.build();
+
+			//The scaled sphere hides the unscaled one behind it, the quad is reached by a direction two units long
+			Ray rays[] = { Ray{ { 0, 0, 0 }, { 0, 0, -1 } }, Ray{ { 5, 0, 0 }, { 0, 0, -2 } } };
+			float expected[] = { 10 - k, 10 };
+			for (int i = 0; i < 2; i++) {
+				Hit hit;
+				float t = checked->intersect(rays[i], hit) ? rays[i].tMax : -1;
+				bool passed = std::abs(t - expected[i]) < 1e-4f * expected[i];
+				numFailures += passed ? 0 : 1;
+				std::cout << "Scale " << k << ", ray " << i << ": t " << t << ", expected " << expected[i] << (passed ? "" : " FAILED") << std::endl;
+			}
+		}
+		return numFailures == 0 ? 0 : 1;
+	}
+
+	if (mode == "--check-mesh-lights") { //Fails unless light sampled from an emissive quad mesh matches its analytic irradiance
+		int numFailures = 0;
+		Poi3f quad[] = { { -1, -1, 0 }, { 1, -1, 0 }, { 1, 1, 0 }, { -1, 1, 0 } };
+		int indexes[] = { 0, 1, 2, 0, 2, 3 };
+		for (float k : { 1.0f, 3.0f }) {
+			SceneBuilder builder;
+			MaterialHandle light = builder.addMaterial(Material{ Vec3f{ 0, 0, 0 }, Vec3f{ 1, 1, 1 } });
+			builder.addObject(Transform::Translation(0, 0, -2)(Transform::Rotation(0.7f, { 0, 0, 1 })(Transform::Scale(k))),
+				builder.addTriangleMesh(quad, 4, indexes, 2), light);
+			std::shared_ptr<Scene> checked = builder.build();
+
+			//Irradiance at the origin facing the square, whose half side is k at distance 2, from four corner form factors
+			float x = k / 2;
+			float expected = 4 * x / std::sqrt(1 + x * x) * std::atan(x / std::sqrt(1 + x * x));
+			const int numSamples = 1 << 20;
+			double sum = 0;
+			for (int i = 0; i < numSamples; i++) {
+				LightSample sample;
+				if (checked->sampleLight({ 0, 0, 0 }, Norm3f{ 0, 0, -1 }, sample))
+					sum += sample.emission.x * std::max(0.0f, -normalize(sample.p - Poi3f{ 0, 0, 0 }).z) / sample.pdf;
+			}
+			float estimate = (float)(sum / numSamples);
+			bool passed = std::abs(estimate - expected) < 0.01f * expected;
+			numFailures += passed ? 0 : 1;
+			std::cout << "Scale " << k << ": irradiance " << estimate << ", expected " << expected << (passed ? "" : " FAILED") << std::endl;
+		}
+
+		SceneBuilder builder;
+		MaterialHandle light = builder.addMaterial(Material{ Vec3f{ 0, 0, 0 }, Vec3f{ 1, 1, 1 } });
+		builder.addObject(Transform::Scale(1, 2, 1), builder.addTriangleMesh(quad, 4, indexes, 2), light);
+		bool rejected = false;
+		try {
+			builder.build();
+		}
+		catch (const char*) {
+			rejected = true;
+		}
+		numFailures += rejected ? 0 : 1;
+		std::cout << "Stretched emitter " << (rejected ? "rejected" : "accepted FAILED") << std::endl;
+		return numFailures == 0 ? 0 : 1;
+	}
+
+	if (mode == "--converge") { //Error against time for every scene, or just --scene, appended to a csv
+		std::string csvPath = argc > 2 && argv[2][0] != '-' ? argv[2] : "convergence.csv";
+		ConvergenceBenchmark::Settings settings;
+		if (sceneGiven)
+			settings.scenes = { sceneName };
+		settings.cacheCellSize = cache ? cache->getCellSize() : 0;
+		settings.label = label;
+		std::ofstream csv(csvPath, std::ofstream::app);
+		if (csv.tellp() == 0)
+			ConvergenceBenchmark::writeCsvHeader(csv);
+		ConvergenceBenchmark{ settings }.run(csv);
+		return 0;
+	}
 
-int main() {
 	Timer t;
 	t.mark();
 
 	std::cout << "Initilizing Scene: ";
-	std::vector<std::shared_ptr<Object>> objects;
-	std::shared_ptr<Material> matte = std::make_shared<Material>(Vec3f{ 0.8f, 0.8f, 0.8f });
-	std::shared_ptr<Material> matte2 = std::make_shared<Material>(Vec3f{ 0.2f, 0.5f, 0.2f });
-	std::shared_ptr<Material> light = std::make_shared<Material>(Vec3f{ 0.0f, 0.0f, 0.0f }, Vec3f{1.0f, 1.0f, 1.0f});
-	std::shared_ptr<Material> light2 = std::make_shared<Material>(Vec3f{ 0.3f, 0.3f, 0.3f }, Vec3f{ 0.7f, 0.7f, 1.0f });
-
-	
-
-	objects.emplace_back(std::make_shared<Object>(std::make_shared<Sphere>(Poi3f{0.0f, -101.0f, -5.0f}, 100.0f), matte2));
-	objects.emplace_back(std::make_shared<Object>(std::make_shared<Sphere>(Poi3f{ 0.0f, 1.0f, -5.0f }, 2.0f), matte));
-	objects.emplace_back(std::make_shared<Object>(std::make_shared<Sphere>(Poi3f{ 0.0, 80.0f, 0.0f }, 50.0f), light2));
-	/*objects.emplace_back(new Sphere({ 0, 1, -5 }, 1));
-	objects.emplace_back(new Sphere({ 5, 1, -5 }, 1));
-	objects.emplace_back(new Sphere({ -5, 1, -5 }, 1));
-	objects.emplace_back(new Sphere({ -5, 5, -5 }, 1));*/
-	std::shared_ptr<Scene> scene{ new Scene(objects) };
+	std::shared_ptr<Scene> scene;
+	{
+		TRACE_SCOPE("Build scene");
+		scene = loadScene();
+	}
 	Renderer r{ scene };
-	Camera c{ {320 * 5, 180 * 5}, 90, r, 1000 };
+	r.setRadianceCache(cache.get());
+	Vec2i resolution{ 320 * 5, 180 * 5 };
+	float verticalFov = 90;
+	int aaNumSamples = 1000;
+	Camera c{ resolution, verticalFov, r, aaNumSamples };
 	//Camera c{ {150, 100}, 90, r, 1000 };
 	//Camera c{ {1920, 1080}, 90, s };
 	std::cout << t.mark().count() << std::endl;
@@ -46,17 +237,124 @@ int main() {
 		std::cout << r.dir << " " << weight << "\n";
 	}*/
 
+	if (mode == "--animate") { //Bobs the middle sphere up and down, one ppm per frame
+		int numFrames = argc > 2 ? std::stoi(argv[2]) : 24;
+		Animation anim{ scene, { { 1, [](float time) { return Transform::Translation(0, std::sin(2 * PI * time), 0); } } } };
+		anim.render(c, {}, numFrames, 24, [&t](int frame, const Image& img) {
+			char name[32];
+			std::snprintf(name, sizeof(name), "render_%04d.ppm", frame);
+			std::ofstream frameFile(name, std::ofstream::binary);
+			img.writeEncodedPpm(frameFile);
+			std::cout << "Frame " << frame << ": " << t.mark().count() << std::endl;
+		});
+		return 0;
+	}
+
+	if (mode == "--incremental") { //Recolors then moves the middle sphere, re-rendering only the tiles each edit reaches
+		IncrementalRender incremental{ c, scene };
+		size_t numTiles = incremental.render();
+		std::cout << "Full frame, " << numTiles << " tiles: " << t.mark().count() << std::endl;
+		scene->getMaterial(scene->getObject(1).getMaterial().index).color = Vec3f{ 0.8f, 0.3f, 0.1f };
+		incremental.materialChanged(scene->getObject(1).getMaterial().index);
+		numTiles = incremental.render();
+		std::cout << "Recolored, " << numTiles << " tiles: " << t.mark().count() << std::endl;
+		scene->getObject(1).setTransform(Transform::Translation(1.5f, 0, 0));
+		scene->update();
+		incremental.objectMoved(1);
+		numTiles = incremental.render();
+		std::cout << "Moved, " << numTiles << " tiles: " << t.mark().count() << std::endl;
+		std::ofstream imgFile("render.ppm", std::ofstream::binary);
+		incremental.toImage().writeEncodedPpm(imgFile);
+		return 0;
+	}
+
+	if (mode == "--stream") { //Tiles go to disk as they finish, the frame is never held in memory
+		std::cout << "Rendering Scene To File: ";
+		TRACE_SCOPE("Render");
+		c.renderToFile({}, "render.ppm");
+		std::cout << t.mark().count() << std::endl;
+		return 0;
+	}
+
+	if (mode == "--check-threads") { //Renders on a pool of several threads, fails unless every pixel came back
+		Film film(resolution.x, resolution.y);
+		for (int y = 0; y < resolution.y; y++) {
+			for (int x = 0; x < resolution.x; x++)
+				film(x, y) = Vec3f{ -1, -1, -1 }; //Radiance is never negative
+		}
+		c.renderImage({}, film);
+		int numMissing = 0;
+		for (int y = 0; y < resolution.y; y++) {
+			for (int x = 0; x < resolution.x; x++) {
+				Vec3f v = film(x, y);
+				numMissing += (v.x >= 0 && v.y >= 0 && v.z >= 0) ? 0 : 1;
+			}
+		}
+		std::cout << getThreadPool().getNumThreads() << " threads: " << numMissing << " pixels missing, " << t.mark().count() << std::endl;
+		return numMissing == 0 ? 0 : 1;
+	}
+
+	if (mode == "--check-allocations") { //Renders a frame to warm up, then fails if the next one allocates anything
+		c.warmUp({});
+		Film film(resolution.x, resolution.y);
+		std::vector<Image::Pixel> frame((size_t)resolution.x * resolution.y);
+		uint64_t numAllocations = 0;
+		for (int i = 0; i < 2; i++) {
+			AllocationCounter counter;
+			c.renderImage({}, film);
+			film.tonemap(frame.data());
+			numAllocations = counter.getCount();
+			std::cout << (i == 0 ? "Warm up frame: " : "Steady frame: ") << numAllocations << " allocations, " << t.mark().count() << std::endl;
+		}
+		return numAllocations == 0 ? 0 : 1;
+	}
+
+	if (mode == "--mlt") { //Metropolis light transport, the argument is mutations per pixel, see Metropolis.h
+		Metropolis::Settings settings;
+		settings.mutationsPerPixel = argc > 2 && argv[2][0] != '-' ? std::stoi(argv[2]) : aaNumSamples;
+		std::cout << "Rendering Scene With Metropolis: ";
+		Image render = [&] {
+			TRACE_SCOPE("Render");
+			return Metropolis{ settings }.render(c, {});
+		}();
+		std::cout << t.mark().count() << std::endl;
+		std::ofstream imgFile("render.ppm", std::ofstream::binary);
+		render.writeEncodedPpm(imgFile);
+		return 0;
+	}
+
+	int numTrainingPasses = (mode == "--guided" && argc > 2) ? std::stoi(argv[2]) : 6; //Path guiding, see PathGuide.h
+	PathGuide guide;
+
 	std::cout << "Rendering Scene: ";
-	Image render = c.renderImage({});
+	Image render = [&] {
+		TRACE_SCOPE("Render");
+		return numWorkers > 0
+			? Coordinator{ { resolution.x, resolution.y, verticalFov, aaNumSamples, TILE_SIZE }, numWorkers, argv[0], sceneName, workerFlags }.render()
+			: mode == "--numa" ? NumaRenderer{ scene }.render(c, {})
+			: mode == "--guided" ? c.renderGuided({}, guide, numTrainingPasses) : c.renderImage({});
+	}();
 	std::cout << t.mark().count() << std::endl;
 
 	std::cout << "Writing Image To File: ";
-	std::ofstream imgFile;
-	imgFile.open("render.ppm", std::ofstream::binary);
-	render.writeEncodedPpm(imgFile);
-	imgFile << render;
-	imgFile.close();
+	{
+		TRACE_SCOPE("Write image");
+		CounterScope counters(PHASE_OUTPUT);
+		std::ofstream imgFile;
+		imgFile.open("render.ppm", std::ofstream::binary);
+		render.writeEncodedPpm(imgFile);
+		imgFile << render;
+		imgFile.close();
+	}
 	std::cout << t.mark().count() << std::endl;
 	return 0;
-};
+}
 
+int main(int argc, char** argv) {
+	try {
+		return run(argc, argv);
+	} catch (const char* message) { //Failures are thrown as strings throughout, e.g. every distributed worker dying
+		std::cerr << "Error: " << message << std::endl;
+		return 1;
+	}
+}
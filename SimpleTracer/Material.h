@@ -5,20 +5,26 @@
 #include "Intersection.h"
 #include "Random.h"
 #include "Transform.h"
+#include "Texture.h"
+#include <memory>
 #include <cmath>
 
-Vec3f UniformSampleHemisphere(const Poi2f& u) {
+inline Vec3f UniformSampleHemisphere(const Poi2f& u) {
 	float z = u[0];
 	float r = std::sqrt(std::max((float)0, (float)1. - z * z));
 	float phi = 2 * PI * u[1];
 	return Vec3f(r * std::cos(phi), r * std::sin(phi), z);
 }
 
-float UniformHemispherePdf() {
+inline float UniformHemispherePdf() {
 	return 1 / (2 * PI);
 }
 
-Vec3f randomInUnitSphere() {
+inline float luminance(const Vec3f& c) {
+	return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+}
+
+inline Vec3f randomInUnitSphere() {
 	Vec3f p;
 	do {
 		p = 2 * Vec3f(randomF(), randomF(), randomF()) - Vec3f{1, 1, 1};
@@ -29,6 +35,7 @@ Vec3f randomInUnitSphere() {
 struct Material {
 	Vec3f color;
 	Vec3f light;
+	std::shared_ptr<Texture> texture; //Multiplies color when set
 
 	Material(Vec3f color) :
 		Material(color, {0, 0, 0})
@@ -39,21 +46,36 @@ struct Material {
 		light(light)
 	{}
 
+	Material(std::shared_ptr<Texture> texture, Vec3f light = { 0, 0, 0 }) :
+		color({ 1, 1, 1 }),
+		light(light),
+		texture(std::move(texture))
+	{}
+
+	//Reflectance at the hit, footprint is the world space width of the ray cone there and picks the mip level
+	Vec3f albedo(const Intersection& insect, float footprint) const {
+		if (!texture)
+			return color;
+		Vec3f t = texture->lookup(insect.uv, footprint, insect.dpdu, insect.dpdv);
+		return { color.x * t.x, color.y * t.y, color.z * t.z };
+	}
+
 	Ray getScatteredRay(const Intersection& insect, float* weight = nullptr) const {
 		Poi3f p = insect.p;
 		Norm3f n = insect.n;
-		Vec3f s = normalize(insect.dpdu);
-
-		if (s == Vec3f{ 0, 0, 0 }) { //dpdu might be zero (say for example at pole of sphere)
-			s = normalize(insect.dpdv); //so use dvdu instead for tangentness
-		}
 
-		Vec3f t = normalize(cross(s, n));
-		Mat33f m{	
-			s.x, s.y, s.z,
-			t.x, t.y, t.z,
-			n.x, n.y, n.z
+		//Gram-Schmidt against n, a shape's derivatives needn't be perpendicular to its shading normal
+		auto tangent = [&n](const Vec3f& d) {
+			Vec3f s = d - dot(d, n) * Vec3f(n);
+			return s.length() > 1e-4f * d.length() ? normalize(s) : Vec3f{ 0, 0, 0 };
 		};
+		Vec3f s = tangent(insect.dpdu);
+		if (s == Vec3f{ 0, 0, 0 }) //dpdu might be zero or along n (say for example at pole of sphere)
+			s = tangent(insect.dpdv); //so use dpdv instead for tangentness
+		if (s == Vec3f{ 0, 0, 0 }) //Neither is a tangent, as on triangles with degenerate uvs, so any perpendicular does
+			s = tangent(std::abs(n.x) > 0.9f ? Vec3f{ 0, 1, 0 } : Vec3f{ 1, 0, 0 });
+
+		Vec3f t = cross(Vec3f(n), s);
 
 		float a = randomF();
 		float b = randomF();
@@ -64,7 +86,7 @@ struct Material {
 		if (weight != nullptr) {
 			*weight = 1 / (2 * PI);
 		}
-		return Ray{ p, m * Vec3f{x, y, z} };
+		return Ray{ p, x * s + y * t + z * Vec3f(n) }; //Out of the shading frame, so z follows the normal
 	}
 		
 	~Material() {};
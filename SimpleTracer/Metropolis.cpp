@@ -0,0 +1,187 @@
+#include "Metropolis.h"
+#include "AliasTable.h"
+#include "Film.h"
+#include "Material.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+static constexpr float ONE_MINUS_EPSILON = 0.99999994f;
+
+static void atomicAdd(std::atomic<float>& a, float value) {
+	float old = a.load(std::memory_order_relaxed);
+	while (!a.compare_exchange_weak(old, old + value, std::memory_order_relaxed)) {}
+}
+
+PrimarySampler::PrimarySampler(uint64_t seed, float largeStepProbability, float sigma) :
+	generator((std::mt19937::result_type)seed),
+	uniform(0, 1),
+	normal(0, 1),
+	largeStepProbability(largeStepProbability),
+	sigma(sigma)
+{}
+
+void PrimarySampler::startIteration() {
+	iteration++;
+	largeStep = uniform(generator) < largeStepProbability;
+	index = 0;
+}
+
+void PrimarySampler::accept() {
+	if (largeStep)
+		lastLargeStep = iteration;
+}
+
+void PrimarySampler::reject() {
+	for (PrimarySample& sample : samples) {
+		if (sample.lastModified == iteration) {
+			sample.value = sample.backupValue;
+			sample.lastModified = sample.backupModified;
+		}
+	}
+	iteration--;
+}
+
+void PrimarySampler::ensureReady(size_t i) {
+	if (i >= samples.size()) { //Numbers no path asked for before are as good drawn fresh as mutated from anything
+		float value = std::min(uniform(generator), ONE_MINUS_EPSILON);
+		samples.push_back({ value, iteration, value, iteration });
+		return;
+	}
+
+	PrimarySample& sample = samples[i];
+	if (sample.lastModified < lastLargeStep) { //Missed an accepted large step, which would have redrawn it
+		sample.value = std::min(uniform(generator), ONE_MINUS_EPSILON);
+		sample.lastModified = lastLargeStep;
+	}
+	sample.backupValue = sample.value;
+	sample.backupModified = sample.lastModified;
+	if (largeStep) {
+		sample.value = std::min(uniform(generator), ONE_MINUS_EPSILON);
+	} else { //Catches up on every small step it sat out, their sum is one wider normal step
+		int64_t numSmallSteps = iteration - sample.lastModified;
+		if (numSmallSteps > 0) {
+			sample.value += normal(generator) * sigma * std::sqrt((float)numSmallSteps);
+			sample.value = std::min(sample.value - std::floor(sample.value), ONE_MINUS_EPSILON);
+		}
+	}
+	sample.lastModified = iteration;
+}
+
+float PrimarySampler::next() {
+	ensureReady(index);
+	return samples[index++].value;
+}
+
+//Film that any thread can add to at any time, Metropolis splats land anywhere on the image
+struct SplatFilm {
+private:
+	Vec2i resolution;
+	std::vector<std::atomic<float>> channels; //Three per pixel, row major
+public:
+	explicit SplatFilm(Vec2i resolution) :
+		resolution(resolution),
+		channels((size_t)resolution.x * resolution.y * 3)
+	{}
+
+	void splat(const Poi2f& raster, const Vec3f& radiance) {
+		int x = std::min(std::max((int)raster.x, 0), resolution.x - 1);
+		int y = std::min(std::max((int)raster.y, 0), resolution.y - 1);
+		size_t i = ((size_t)y * resolution.x + x) * 3;
+		for (int c = 0; c < 3; c++)
+			atomicAdd(channels[i + c], radiance[c]);
+	}
+
+	Film toFilm(float scale) const {
+		Film film(resolution.x, resolution.y);
+		for (int y = 0; y < resolution.y; y++) {
+			for (int x = 0; x < resolution.x; x++) {
+				size_t i = ((size_t)y * resolution.x + x) * 3;
+				film(x, y) = Vec3f{ channels[i].load(), channels[i + 1].load(), channels[i + 2].load() } * scale;
+			}
+		}
+		return film;
+	}
+};
+
+//One camera path through the raster position the first two numbers pick, traced with the installed sample source
+static Vec3f tracePath(const Camera& camera, const Transform& camToWorld, const ViewingFrustum& frustum, Poi2f& raster) {
+	Vec2i resolution = camera.getResolution();
+	raster = Poi2f{ randomF() * resolution.x, randomF() * resolution.y };
+	Ray r = camToWorld(frustum.generateRay(Poi2f{ raster.x / resolution.x, raster.y / resolution.y }));
+	r.coneSpread = camera.getPixelSpread();
+	PathState path{ r, { 1, 1, 1 }, { 0, 0, 0 }, 0 };
+	camera.getRenderer().trace(&path, 1);
+	return std::isfinite(luminance(path.radiance)) ? path.radiance : Vec3f{ 0, 0, 0 };
+}
+
+Image Metropolis::render(const Camera& camera, const Transform& camToWorld) const {
+	TRACE_SCOPE("Metropolis");
+	Vec2i resolution = camera.getResolution();
+	ViewingFrustum frustum{ resolution, camera.getVerticalFov() };
+	ThreadPool& pool = getThreadPool();
+
+	//Seed i's first path is the same in the bootstrap and in any chain started from it
+	std::vector<float> brightness(settings.bootstrapSamples);
+	{
+		TRACE_SCOPE("Bootstrap", "samples", settings.bootstrapSamples);
+		pool.parallelFor(brightness.size(), [&](size_t i, size_t) {
+			PrimarySampler sampler(i, settings.largeStepProbability, settings.sigma);
+			ScopedSampleSource source(&sampler);
+			Poi2f raster;
+			brightness[i] = luminance(tracePath(camera, camToWorld, frustum, raster));
+		});
+	}
+	double sum = 0;
+	for (float b : brightness)
+		sum += b;
+	float meanBrightness = (float)(sum / brightness.size());
+	if (!(meanBrightness > 0))
+		return Film(resolution.x, resolution.y).toImage();
+	AliasTable seeds(brightness);
+
+	uint64_t numMutations = (uint64_t)settings.mutationsPerPixel * resolution.x * resolution.y;
+	uint64_t numChains = settings.numChains;
+	SplatFilm film(resolution);
+	pool.parallelFor(numChains, [&](size_t chain, size_t) {
+		TRACE_SCOPE("Chain", "chain", (int64_t)chain);
+		std::mt19937 generator((std::mt19937::result_type)(brightness.size() + chain)); //Apart from every seed
+		std::uniform_real_distribution<float> uniform(0, 1);
+		float u = std::min(uniform(generator), ONE_MINUS_EPSILON);
+		PrimarySampler sampler(seeds.sample(u), settings.largeStepProbability, settings.sigma);
+		ScopedSampleSource source(&sampler);
+
+		Poi2f current;
+		Vec3f currentRadiance = tracePath(camera, camToWorld, frustum, current);
+		float currentBrightness = luminance(currentRadiance);
+		uint64_t chainMutations = numMutations / numChains + (chain < numMutations % numChains ? 1 : 0);
+		for (uint64_t m = 0; m < chainMutations; m++) {
+			sampler.startIteration();
+			Poi2f proposed;
+			Vec3f proposedRadiance = tracePath(camera, camToWorld, frustum, proposed);
+			float proposedBrightness = luminance(proposedRadiance);
+
+			//Both states are splatted by their odds of being where the chain is next, which wastes no proposal
+			float accept = currentBrightness > 0 ? std::min(1.0f, proposedBrightness / currentBrightness) : 1;
+			if (accept > 0)
+				film.splat(proposed, proposedRadiance * (accept / proposedBrightness));
+			if (accept < 1)
+				film.splat(current, currentRadiance * ((1 - accept) / currentBrightness));
+
+			if (uniform(generator) < accept) {
+				current = proposed;
+				currentRadiance = proposedRadiance;
+				currentBrightness = proposedBrightness;
+				sampler.accept();
+			} else {
+				sampler.reject();
+			}
+		}
+	});
+
+	//Chains spend time in proportion to brightness, the bootstrap says how bright that is in absolute terms
+	TRACE_SCOPE("Tonemap");
+	return film.toFilm(meanBrightness * resolution.x * resolution.y / numMutations).toImage();
+}
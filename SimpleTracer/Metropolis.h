@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Camera.h"
+#include "Image.h"
+#include "Random.h"
+#include "Transform.h"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+//Primary sample space of one Markov chain: every random number a camera path consumes, in the order it asks for them.
+//Each iteration either redraws all of them (a large step) or nudges each one a little, and a rejected proposal puts
+//back exactly what it changed. Numbers are only mutated once a path asks for them, so short paths pay for short vectors
+struct PrimarySampler : public SampleSource {
+private:
+	struct PrimarySample {
+		float value;
+		int64_t lastModified; //Iteration the value was last brought up to date in
+		float backupValue;
+		int64_t backupModified;
+	};
+
+	std::mt19937 generator;
+	std::uniform_real_distribution<float> uniform;
+	std::normal_distribution<float> normal;
+	std::vector<PrimarySample> samples;
+	float largeStepProbability;
+	float sigma;
+	int64_t iteration = 0;
+	int64_t lastLargeStep = 0;
+	bool largeStep = true; //Before the first iteration everything is drawn fresh
+	size_t index = 0;
+
+	void ensureReady(size_t i);
+public:
+	//Chains seeded alike replay the same first path, which is how they pick up where the bootstrap left off
+	PrimarySampler(uint64_t seed, float largeStepProbability, float sigma);
+
+	//Proposes the next state, call before tracing each path but the first
+	void startIteration();
+
+	void accept();
+
+	void reject();
+
+	float next();
+
+	bool isLargeStep() const {
+		return largeStep;
+	}
+};
+
+//Primary sample space Metropolis light transport (Kelemen et al.) over the unidirectional path tracer. Chains wander
+//towards paths that carry a lot of light and stay there, so light squeezing through narrow openings is found once and
+//then explored instead of hit by blind luck. Every chain runs on one thread and splats both the proposal and the
+//current state of each step, weighted by acceptance, into a film of atomic floats. A bootstrap of independent paths
+//estimates the image's total brightness, which the relative densities the chains produce are scaled to
+struct Metropolis {
+	struct Settings {
+		int mutationsPerPixel = 100;
+		int bootstrapSamples = 100000; //Independent paths that estimate brightness and seed the chains
+		int numChains = 1000;
+		float largeStepProbability = 0.3f;
+		float sigma = 0.01f; //Standard deviation of small steps in primary sample space
+	};
+private:
+	Settings settings;
+public:
+	explicit Metropolis(const Settings& settings) :
+		settings(settings)
+	{}
+
+	//Renders through camera's renderer, which should not have a path guide or radiance cache: both change between
+	//paths, and Metropolis needs a path to carry the same light whenever its numbers are replayed
+	Image render(const Camera& camera, const Transform& camToWorld) const;
+};
@@ -0,0 +1,124 @@
+#include "Numa.h"
+#include "Tile.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#ifndef _WIN32
+//Parses sysfs cpu lists like "0-7,16-23"
+static std::vector<int> parseCpuList(const std::string& list) {
+	std::vector<int> cpus;
+	std::stringstream ss(list);
+	std::string range;
+	while (std::getline(ss, range, ',')) {
+		if (range.empty() || range == "\n")
+			continue;
+		size_t dash = range.find('-');
+		int first = std::stoi(range.substr(0, dash));
+		int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+		for (int cpu = first; cpu <= last; cpu++)
+			cpus.push_back(cpu);
+	}
+	return cpus;
+}
+#endif
+
+NumaTopology NumaTopology::detect() {
+	NumaTopology topology;
+#ifdef _WIN32
+	ULONG highestNode = 0;
+	if (GetNumaHighestNodeNumber(&highestNode)) {
+		for (USHORT node = 0; node <= highestNode; node++) {
+			GROUP_AFFINITY affinity;
+			if (!GetNumaNodeProcessorMaskEx(node, &affinity))
+				continue;
+			std::vector<int> cpus;
+			for (int bit = 0; bit < 64; bit++)
+				if (affinity.Mask & ((KAFFINITY)1 << bit))
+					cpus.push_back(affinity.Group * 64 + bit);
+			if (!cpus.empty())
+				topology.nodeCpus.push_back(cpus);
+		}
+	}
+#else
+	for (int node = 0; ; node++) {
+		std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		if (!cpulist)
+			break;
+		std::string list;
+		std::getline(cpulist, list);
+		std::vector<int> cpus = parseCpuList(list);
+		if (!cpus.empty()) //Memory only nodes have no cpus to run on
+			topology.nodeCpus.push_back(cpus);
+	}
+#endif
+	if (topology.nodeCpus.empty()) {
+		std::vector<int> cpus;
+		for (int cpu = 0; cpu < (int)std::max(std::thread::hardware_concurrency(), 1u); cpu++)
+			cpus.push_back(cpu);
+		topology.nodeCpus.push_back(cpus);
+	}
+	return topology;
+}
+
+std::vector<int> NumaRenderer::cpusByNode(const NumaTopology& topology) {
+	std::vector<int> cpus;
+	for (const std::vector<int>& node : topology.nodeCpus)
+		cpus.insert(cpus.end(), node.begin(), node.end());
+	return cpus;
+}
+
+NumaRenderer::NumaRenderer(std::shared_ptr<Scene> scene, const NumaTopology& topology) :
+	topology(topology),
+	pool(cpusByNode(topology))
+{
+	for (size_t node = 0; node < topology.getNumNodes(); node++)
+		threadNodes.insert(threadNodes.end(), topology.nodeCpus[node].size(), (int)node);
+
+	if (getNumNodes() == 1) {
+		nodeRenderers.emplace_back(scene);
+		return;
+	}
+
+	std::vector<std::shared_ptr<Scene>> replicas(getNumNodes());
+	pool.forEachThread([&](size_t thread) {
+		int node = threadNodes[thread];
+		if (thread == 0 || threadNodes[thread - 1] != node)
+			replicas[node] = scene->clone();
+	});
+	for (const std::shared_ptr<Scene>& replica : replicas)
+		nodeRenderers.emplace_back(replica);
+}
+
+Image NumaRenderer::render(const Camera& camera, const Transform& camToWorld) {
+	Vec2i resolution = camera.getResolution();
+	std::vector<std::unique_ptr<Film>> films(getNumNodes());
+	std::vector<std::vector<Vec3f>> tileBuffers(pool.getNumThreads());
+	pool.forEachThread([&](size_t thread) {
+		int node = threadNodes[thread];
+		tileBuffers[thread].resize(TILE_SIZE * TILE_SIZE);
+		if (thread == 0 || threadNodes[thread - 1] != node)
+			films[node] = std::make_unique<Film>(resolution.x, resolution.y);
+	});
+
+	std::vector<Tile> tiles = makeTiles(resolution);
+	SharedOrigin origin; //Replicas list the same objects in the same order, so one set of terms serves every node
+	camera.prepareOrigin(camToWorld, origin);
+	expectTiles(tiles.size());
+	pool.parallelFor(tiles.size(), [&](size_t i, size_t thread) {
+		int node = threadNodes[thread];
+		camera.renderTile(camToWorld, tiles[i], tileBuffers[thread].data(), nodeRenderers[node], nullptr, &origin);
+		films[node]->putTile(tiles[i], tileBuffers[thread].data());
+	});
+
+	//Each tile landed in exactly one film and the rest are zero there, so summing merges them
+	for (size_t node = 1; node < films.size(); node++)
+		*films[0] += *films[node];
+	return films[0]->toImage();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Camera.h"
+#include "Film.h"
+#include "Image.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+#include "Transform.h"
+#include <memory>
+#include <vector>
+
+//Which logical cpus belong to which memory node. Machines without NUMA show up as a single node
+struct NumaTopology {
+	std::vector<std::vector<int>> nodeCpus;
+
+	static NumaTopology detect();
+
+	size_t getNumNodes() const {
+		return nodeCpus.size();
+	}
+};
+
+//Renders with every worker pinned to a core and a copy of the scene per memory node, so hierarchy and
+//object reads never cross the socket interconnect. Replicas and the per-node films are allocated by a
+//thread on their node, first touch then places their pages in that node's memory
+struct NumaRenderer {
+private:
+	NumaTopology topology;
+	std::vector<int> threadNodes; //Node of each pool thread
+	ThreadPool pool;
+	std::vector<Renderer> nodeRenderers;
+
+	static std::vector<int> cpusByNode(const NumaTopology& topology);
+public:
+	//Must be constructed on the thread that will call render, which becomes the pool's pinned thread 0
+	explicit NumaRenderer(std::shared_ptr<Scene> scene, const NumaTopology& topology = NumaTopology::detect());
+
+	size_t getNumNodes() const {
+		return topology.getNumNodes();
+	}
+
+	//Tiles go to whichever thread is free, rendered with its node's scene into its node's film, the films get summed at the end
+	Image render(const Camera& camera, const Transform& camToWorld);
+};
@@ -3,33 +3,128 @@
 #include "Hittable.h"
 #include "Shape.h"
 #include "Material.h"
+#include "Arena.h"
 
-struct Object : public Hittable {
-	Object(std::shared_ptr<Shape> shape, std::shared_ptr<Material> material) :
-		Object(Transform(), shape, material)
-	{}
+struct Object;
+
+using ShapeHandle = Handle<Shape>;
+using MaterialHandle = Handle<Material>;
+using ObjectHandle = Handle<Object>;
 
-	Object(Transform fromObject, std::shared_ptr<Shape> shape, std::shared_ptr<Material> material) :
+//Instance of a shape placed in the world. Objects live by value in their scene's object table, shapes in its arena
+struct Object : public Hittable {
+	Object(Transform fromObject, ShapeHandle shapeHandle, const Shape* shape, MaterialHandle material) :
 		fromObject(fromObject),
+		toObject(inv(fromObject)),
+		scale(fromObject.uniformScale()),
+		shapeHandle(shapeHandle),
 		shape(shape),
-		material(material)
+		materialId(material.index)
 	{}
 
-	virtual bool intersect(const Ray& r, Intersection* insect = nullptr) const {
-		Transform toObject = inv(fromObject);
+	using Hittable::intersect;
+
+	virtual bool intersect(const Ray& r, Hit& hit) const {
 		Ray r2 = toObject(r);
-		bool hit = shape->intersect(r2, insect);
-		if (hit) {
-			if (insect != nullptr) {
-				*insect = fromObject(*insect);
-				insect->m = &(*material);
-			}
-			r = fromObject(r2);
+		bool found = shape->intersect(r2, hit);
+		if (found) {
+			hit.object = this;
+			r.tMax = r2.tMax; //Transforms keep t, so the shortened range carries straight back to the caller
+		}
+		return found;
+	}
+
+	//World space origin shared by the rays intersectFrom will be called with
+	void prepareOrigin(const Poi3f& org, OriginTerms& terms) const {
+		terms.org = toObject(org);
+		shape->prepareOrigin(terms);
+	}
+
+	//Same as intersect for a ray leaving the point terms were prepared for, which only has its direction left to transform
+	bool intersectFrom(const Ray& r, const OriginTerms& terms, Hit& hit) const {
+		Ray r2 = toObject(r, terms.org);
+		bool found = shape->intersectFrom(r2, terms, hit);
+		if (found) {
+			hit.object = this;
+			r.tMax = r2.tMax;
 		}
-		return hit;
+		return found;
+	}
+
+	using Hittable::occluded;
+
+	virtual bool occluded(const Ray& r) const {
+		return shape->occluded(toObject(r));
+	}
+
+	virtual void finalize(const Ray& r, const Hit& hit, Intersection& insect) const {
+		shape->finalize(toObject(r), hit, insect);
+		insect = fromObject(insect);
+		insect.materialId = materialId;
+	}
+
+	Bounds3f worldBound() const {
+		return fromObject(shape->objectBound());
+	}
+
+	//Light pieces, see Shape::numLightPieces. Only transforms with a uniform scale keep solid angles, so for them
+	//areas grow by the scale squared and pdfs carry over from object space, Scene rejects emitters placed by any other
+	uint32_t numLightPieces() const {
+		return shape->numLightPieces();
+	}
+
+	Bounds3f worldBound(uint32_t piece) const {
+		return fromObject(shape->pieceBound(piece));
+	}
+
+	float area(uint32_t piece) const {
+		return scale * scale * shape->pieceArea(piece);
+	}
+
+	float sampleSurface(uint32_t piece, const Poi3f& ref, const Poi2f& u, Poi3f& p, Norm3f& n) const {
+		float pdf = shape->samplePiece(piece, toObject(ref), u, p, n);
+		p = fromObject(p);
+		n = Norm3f(normalize(fromObject(Vec3f(n))));
+		return pdf;
+	}
+
+	DirectionCone worldNormalBounds(uint32_t piece) const {
+		DirectionCone cone = shape->pieceNormalBounds(piece);
+		if (cone.cosTheta > -1)
+			cone.w = normalize(fromObject(cone.w));
+		return cone;
+	}
+
+	//fromObject's uniform scale, 0 if it has none
+	float getScale() const {
+		return scale;
+	}
+
+	ShapeHandle getShape() const {
+		return shapeHandle;
+	}
+
+	MaterialHandle getMaterial() const {
+		return { materialId };
+	}
+
+	const Transform& getTransform() const {
+		return fromObject;
+	}
+
+	//Scene::update has to be called before the next render for the move to show up
+	void setTransform(const Transform& fromObject) {
+		this->fromObject = fromObject;
+		toObject = inv(fromObject);
+		scale = fromObject.uniformScale();
 	}
 private:
+	friend struct Scene; //Points cloned objects at the cloned shapes
+
 	Transform fromObject;
-	std::shared_ptr<Shape> shape;
-	std::shared_ptr<Material> material;
+	Transform toObject;
+	float scale; //fromObject's uniform scale, 0 if it has none
+	ShapeHandle shapeHandle;
+	const Shape* shape; //Resolved shapeHandle, owned by the scene's arena
+	uint32_t materialId;
 };
@@ -0,0 +1,208 @@
+#include "PathGuide.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+
+static void atomicAdd(std::atomic<float>& a, float value) {
+	float old = a.load(std::memory_order_relaxed);
+	while (!a.compare_exchange_weak(old, old + value, std::memory_order_relaxed)) {}
+}
+
+static Poi2f directionToSquare(const Vec3f& dir) {
+	float phi = std::atan2(dir.y, dir.x);
+	if (phi < 0)
+		phi += 2 * PI;
+	float u = std::max(0.0f, std::min(0.99999994f, (dir.z + 1) / 2));
+	float v = std::max(0.0f, std::min(0.99999994f, phi / (2 * PI)));
+	return { u, v };
+}
+
+static Vec3f squareToDirection(const Poi2f& pos) {
+	float cosTheta = 2 * pos.x - 1;
+	float sinTheta = std::sqrt(std::max(0.0f, 1 - cosTheta * cosTheta));
+	float phi = 2 * PI * pos.y;
+	return { sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta };
+}
+
+//Which quadrant pos falls in, rescaling pos to that quadrant's own unit square
+static int descend(Poi2f& pos) {
+	int q = 0;
+	for (int axis = 0; axis < 2; axis++) {
+		if (pos[axis] >= 0.5f) {
+			q |= 1 << axis;
+			pos[axis] -= 0.5f;
+		}
+		pos[axis] *= 2;
+	}
+	return q;
+}
+
+float DTree::getTotal() const {
+	const Node& root = nodes[0];
+	return root.sums[0] + root.sums[1] + root.sums[2] + root.sums[3];
+}
+
+void DTree::record(const Vec3f& dir, float weight) {
+	Poi2f pos = directionToSquare(dir);
+	uint32_t n = 0;
+	while (true) {
+		int q = descend(pos);
+		atomicAdd(nodes[n].sums[q], weight);
+		if (nodes[n].children[q] == 0)
+			return;
+		n = nodes[n].children[q];
+	}
+}
+
+Vec3f DTree::sample(float& pdf) const {
+	Poi2f origin{ 0, 0 };
+	float size = 1;
+	float squarePdf = 1;
+	uint32_t n = 0;
+	while (true) {
+		const Node& node = nodes[n];
+		float sums[4] = { node.sums[0], node.sums[1], node.sums[2], node.sums[3] };
+		float total = sums[0] + sums[1] + sums[2] + sums[3];
+		float u = randomF() * total;
+		int q = 0;
+		for (; q < 3 && u >= sums[q]; q++)
+			u -= sums[q];
+		while (sums[q] == 0) //Rounding can carry u past the last quadrant with energy
+			q--;
+		squarePdf *= 4 * sums[q] / total;
+		size /= 2;
+		origin.x += (q & 1) * size;
+		origin.y += (q >> 1) * size;
+		if (node.children[q] == 0)
+			break;
+		n = node.children[q];
+	}
+	pdf = squarePdf / (4 * PI);
+	return squareToDirection(Poi2f{ origin.x + randomF() * size, origin.y + randomF() * size });
+}
+
+float DTree::pdf(const Vec3f& dir) const {
+	Poi2f pos = directionToSquare(dir);
+	float squarePdf = 1;
+	uint32_t n = 0;
+	while (true) {
+		const Node& node = nodes[n];
+		float total = node.sums[0] + node.sums[1] + node.sums[2] + node.sums[3];
+		int q = descend(pos);
+		if (total <= 0)
+			return 0;
+		squarePdf *= 4 * node.sums[q] / total;
+		if (node.children[q] == 0 || squarePdf == 0)
+			break;
+		n = node.children[q];
+	}
+	return squarePdf / (4 * PI);
+}
+
+DTree DTree::refined() const {
+	DTree tree;
+	float total = getTotal();
+	struct Entry {
+		uint32_t node; //In the new tree
+		int32_t source; //Matching node of this tree, -1 where the new tree goes deeper than this one did
+		float energy; //Spread evenly over the quadrants when there is no source
+		int depth;
+	};
+	std::vector<Entry> stack{ { 0, 0, total, 1 } };
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+		for (int q = 0; q < 4; q++) {
+			float energy = entry.source >= 0 ? (float)nodes[entry.source].sums[q] : entry.energy / 4;
+			tree.nodes[entry.node].sums[q] = energy;
+			if (total <= 0 || energy / total <= SPLIT_FRACTION || entry.depth >= MAX_DEPTH)
+				continue;
+			uint32_t child = (uint32_t)tree.nodes.size();
+			tree.nodes.emplace_back();
+			tree.nodes[entry.node].children[q] = child;
+			int32_t source = entry.source >= 0 && nodes[entry.source].children[q] != 0 ? (int32_t)nodes[entry.source].children[q] : -1;
+			stack.push_back({ child, source, energy, entry.depth + 1 });
+		}
+	}
+	return tree;
+}
+
+DTree DTree::emptyCopy() const {
+	DTree tree = *this;
+	for (Node& node : tree.nodes) {
+		for (int q = 0; q < 4; q++)
+			node.sums[q] = 0;
+	}
+	return tree;
+}
+
+uint32_t PathGuide::lookup(const Poi3f& p) const {
+	uint32_t n = 0;
+	while (nodes[n].child != 0)
+		n = nodes[n].child + (p[nodes[n].axis] < nodes[n].split ? 0 : 1);
+	return n;
+}
+
+const DTree* PathGuide::getDistribution(const Poi3f& p) const {
+	const DTree& tree = nodes[lookup(p)].sampling;
+	return tree.getTotal() > 0 ? &tree : nullptr;
+}
+
+void PathGuide::record(const Poi3f& p, const Vec3f& dir, float radiance, float pdf) {
+	SpatialNode& node = nodes[lookup(p)];
+	node.numSamples.fetch_add(1, std::memory_order_relaxed);
+	float weight = radiance / pdf;
+	if (pdf > 0 && weight > 0 && std::isfinite(weight))
+		node.building.record(dir, weight);
+}
+
+void PathGuide::recordBounds(const Bounds3f& bounds) {
+	std::lock_guard<std::mutex> lock(boundsMutex);
+	sampleBounds = merge(sampleBounds, bounds);
+}
+
+void PathGuide::refine() {
+	TRACE_SCOPE("Guide refine", "iteration", iteration);
+	if (nodes.size() == 1 && !sampleBounds.isEmpty())
+		nodes[0].bounds = sampleBounds;
+
+	//Split every leaf that got enough samples. Children start from their parent's distribution and half its count,
+	//and are visited later in the same loop in case they should split again
+	float threshold = SPATIAL_SPLIT_SAMPLES * std::sqrt(std::pow(2.0f, (float)iteration));
+	std::vector<int> depths(nodes.size(), 0);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i].child != 0 || nodes[i].numSamples < threshold || depths[i] >= MAX_SPATIAL_DEPTH)
+			continue;
+		SpatialNode& parent = nodes[i];
+		parent.axis = parent.bounds.maxExtent();
+		parent.split = parent.bounds.centroid()[parent.axis];
+		parent.child = (uint32_t)nodes.size();
+		SpatialNode children[2] = { parent, parent };
+		children[0].bounds.max[parent.axis] = parent.split;
+		children[1].bounds.min[parent.axis] = parent.split;
+		for (SpatialNode& child : children) {
+			child.child = 0;
+			child.numSamples = child.numSamples / 2;
+		}
+		int depth = depths[i] + 1;
+		for (SpatialNode& child : children) { //Invalidates parent
+			nodes.push_back(child);
+			depths.push_back(depth);
+		}
+	}
+
+	std::vector<uint32_t> leaves;
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i].child == 0)
+			leaves.push_back(i);
+	}
+	getThreadPool().parallelFor(leaves.size(), [&](size_t i, size_t) {
+		SpatialNode& leaf = nodes[leaves[i]];
+		leaf.sampling = leaf.building.refined();
+		leaf.building = leaf.sampling.emptyCopy();
+		leaf.numSamples = 0;
+	});
+	iteration++;
+}
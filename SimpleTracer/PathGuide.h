@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Bounds.h"
+#include "LinearAlg.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+//std::atomic that can sit in a vector. Copies are only made while no other thread touches either side
+template<typename T>
+struct CopyableAtomic : public std::atomic<T> {
+	CopyableAtomic(T value = T()) :
+		std::atomic<T>(value)
+	{}
+
+	CopyableAtomic(const CopyableAtomic& other) :
+		std::atomic<T>(other.load(std::memory_order_relaxed))
+	{}
+
+	CopyableAtomic& operator=(const CopyableAtomic& other) {
+		this->store(other.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		return *this;
+	}
+};
+
+//Distribution over directions as a quadtree on the unit square, which maps to the sphere of directions by
+//equal area cylindrical coordinates. Every node keeps the energy that fell in each of its quadrants
+struct DTree {
+private:
+	struct Node {
+		CopyableAtomic<float> sums[4];
+		uint32_t children[4] = { 0, 0, 0, 0 }; //0 where the quadrant is a leaf, the root is nobody's child
+	};
+
+	std::vector<Node> nodes;
+public:
+	static constexpr float SPLIT_FRACTION = 0.01f; //Quadrants holding more of the total energy than this get subdivided
+	static constexpr int MAX_DEPTH = 20;
+
+	DTree() :
+		nodes(1)
+	{}
+
+	float getTotal() const;
+
+	//Adds weight along the path to the leaf holding dir, safe to call from many threads at once
+	void record(const Vec3f& dir, float weight);
+
+	//Direction drawn proportional to the recorded energy, pdf is with respect to solid angle. Needs getTotal() > 0
+	Vec3f sample(float& pdf) const;
+
+	float pdf(const Vec3f& dir) const;
+
+	//Tree shaped after how energy spread in this one: quadrants with enough of it are split, the rest merged.
+	//Keeps the sums, so it can be sampled straight away
+	DTree refined() const;
+
+	//Same structure with every sum zeroed, to record the next pass into
+	DTree emptyCopy() const;
+};
+
+//Learns where light arrives from as passes are traced, after "Practical Path Guiding" (Mueller et al. 2017).
+//A binary tree over space holds two DTrees per leaf: one filled during the current pass and one built from the
+//previous pass that paths sample from. The tree is fitted to where the first pass's paths went rather than to the
+//scene, which can be far bigger than the part of it the camera sees. Recording is lock free, refine runs between passes
+struct PathGuide {
+private:
+	struct SpatialNode {
+		Bounds3f bounds;
+		uint32_t child = 0; //First of two children, 0 for leaves
+		int axis = 0;
+		float split = 0;
+		DTree sampling;
+		DTree building;
+		CopyableAtomic<uint32_t> numSamples;
+	};
+
+	std::vector<SpatialNode> nodes;
+	std::mutex boundsMutex;
+	Bounds3f sampleBounds;
+	int iteration = 0;
+	bool learning = true;
+
+	uint32_t lookup(const Poi3f& p) const; //Leaf holding p
+public:
+	//Leaves split once they collect this many samples times sqrt(2^iteration)
+	static constexpr uint32_t SPATIAL_SPLIT_SAMPLES = 12000;
+	static constexpr int MAX_SPATIAL_DEPTH = 24;
+
+	PathGuide() :
+		nodes(1)
+	{}
+
+	//Distribution to sample at p, null until a pass recorded something around there
+	const DTree* getDistribution(const Poi3f& p) const;
+
+	//radiance arrived at p from dir, a direction drawn with density pdf
+	void record(const Poi3f& p, const Vec3f& dir, float radiance, float pdf);
+
+	//Grows the region the first refine fits the tree to, meant to be called once per batch of records
+	void recordBounds(const Bounds3f& bounds);
+
+	//Call between passes: splits busy regions, then swaps the recorded distributions in for sampling
+	void refine();
+
+	bool isLearning() const {
+		return learning;
+	}
+
+	//Final passes only sample, recording into trees nobody will read is wasted work
+	void setLearning(bool learning) {
+		this->learning = learning;
+	}
+};
@@ -0,0 +1,202 @@
+#include "PerfCounters.h"
+#include "Telemetry.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+static constexpr int NUM_EVENTS = 5;
+static constexpr int MAX_NESTING = 16;
+static const char* const EVENT_NAMES[NUM_EVENTS] = { "task_clock_ns", "cycles", "instructions", "cache_misses", "branch_misses" };
+static constexpr int CYCLES = 1;
+static constexpr int INSTRUCTIONS = 2;
+static const char* const PHASE_NAMES[NUM_COUNTER_PHASES] = { "build", "primary", "bounce", "shading", "output" };
+
+//One per thread that ever counted, owned by the registry so counts outlive the thread. The group stays open for the
+//process's lifetime, pool threads never end before it
+struct ThreadCounters {
+	int leader = -1; //Every event is read through the first one that opened
+	int slots[NUM_EVENTS]; //Position in a group read, -1 if the event didn't open
+	uint64_t last[NUM_EVENTS] = {};
+	uint64_t totals[NUM_COUNTER_PHASES][NUM_EVENTS] = {};
+	CounterPhase phases[MAX_NESTING];
+	int depth = 0;
+};
+
+static std::atomic<bool> countingEnabled{ false };
+static std::atomic<bool> reportedFailure[NUM_EVENTS];
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadCounters>> registry;
+
+static void reportFailure(int event, const char* reason) {
+	if (!reportedFailure[event].exchange(true))
+		std::cerr << "Counter " << EVENT_NAMES[event] << " unavailable: " << reason << std::endl;
+}
+
+#ifdef __linux__
+static const uint32_t EVENT_TYPES[NUM_EVENTS] = { PERF_TYPE_SOFTWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+	PERF_TYPE_HARDWARE };
+static const uint64_t EVENT_CONFIGS[NUM_EVENTS] = { PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+//User space only, which perf_event_paranoid's default of 2 still allows, counting the calling thread on any CPU
+static void openGroup(ThreadCounters& counters) {
+	int numOpen = 0;
+	for (int e = 0; e < NUM_EVENTS; e++) {
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = EVENT_TYPES[e];
+		attr.config = EVENT_CONFIGS[e];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+		int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, counters.leader, 0);
+		counters.slots[e] = fd >= 0 ? numOpen++ : -1;
+		if (fd < 0)
+			reportFailure(e, std::strerror(errno));
+		else if (counters.leader < 0)
+			counters.leader = fd;
+	}
+}
+
+static bool readGroup(const ThreadCounters& counters, uint64_t values[NUM_EVENTS]) {
+	uint64_t buffer[1 + NUM_EVENTS]; //Number of events, then each one's value in the order they opened
+	if (read(counters.leader, buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t))
+		return false;
+	for (int e = 0; e < NUM_EVENTS; e++)
+		values[e] = counters.slots[e] >= 0 ? buffer[1 + counters.slots[e]] : 0;
+	return true;
+}
+#else
+static void openGroup(ThreadCounters& counters) {
+	for (int e = 0; e < NUM_EVENTS; e++) {
+		counters.slots[e] = -1;
+		reportFailure(e, "needs Linux's perf_event_open");
+	}
+}
+
+static bool readGroup(const ThreadCounters&, uint64_t[NUM_EVENTS]) {
+	return false;
+}
+#endif
+
+//Registers and opens the calling thread's counters on first use, the only time counting locks
+static ThreadCounters& getThreadCounters() {
+	thread_local ThreadCounters* counters = nullptr;
+	if (counters == nullptr) {
+		std::lock_guard<std::mutex> lock(registryMutex);
+		registry.push_back(std::make_unique<ThreadCounters>());
+		counters = registry.back().get();
+		openGroup(*counters);
+	}
+	return *counters;
+}
+
+//Everything counted since the last boundary goes to the innermost phase, phases nested too deep count as the deepest kept
+static void chargeInnermost(ThreadCounters& counters, const uint64_t values[NUM_EVENTS]) {
+	if (counters.depth > 0) {
+		uint64_t* totals = counters.totals[counters.phases[std::min(counters.depth, MAX_NESTING) - 1]];
+		for (int e = 0; e < NUM_EVENTS; e++)
+			totals[e] += values[e] - counters.last[e];
+	}
+	std::copy(values, values + NUM_EVENTS, counters.last);
+}
+
+bool isCounting() {
+	return countingEnabled.load(std::memory_order_relaxed);
+}
+
+void setCounting(bool enabled) {
+	countingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void enterCounterPhase(CounterPhase phase) {
+	ThreadCounters& counters = getThreadCounters();
+	uint64_t values[NUM_EVENTS];
+	if (counters.leader < 0 || !readGroup(counters, values))
+		return;
+	chargeInnermost(counters, values);
+	if (counters.depth < MAX_NESTING)
+		counters.phases[counters.depth] = phase;
+	counters.depth++;
+}
+
+void leaveCounterPhase() {
+	ThreadCounters& counters = getThreadCounters();
+	uint64_t values[NUM_EVENTS];
+	if (counters.leader < 0 || counters.depth == 0 || !readGroup(counters, values))
+		return;
+	chargeInnermost(counters, values);
+	counters.depth--;
+}
+
+void writeCounters(std::ostream& stream, uint64_t rays) {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	uint64_t totals[NUM_COUNTER_PHASES + 1][NUM_EVENTS] = {}; //Last row sums every phase
+	bool available[NUM_EVENTS] = {};
+	for (const std::unique_ptr<ThreadCounters>& counters : registry) {
+		for (int e = 0; e < NUM_EVENTS; e++) {
+			available[e] = available[e] || counters->slots[e] >= 0;
+			for (int p = 0; p < NUM_COUNTER_PHASES; p++) {
+				totals[p][e] += counters->totals[p][e];
+				totals[NUM_COUNTER_PHASES][e] += counters->totals[p][e];
+			}
+		}
+	}
+
+	stream << "phase";
+	for (const char* name : EVENT_NAMES)
+		stream << "," << name;
+	stream << ",ipc";
+	for (const char* name : EVENT_NAMES)
+		stream << "," << name << "_per_mray";
+	stream << "\n";
+	for (int p = 0; p <= NUM_COUNTER_PHASES; p++) {
+		stream << (p < NUM_COUNTER_PHASES ? PHASE_NAMES[p] : "total");
+		for (int e = 0; e < NUM_EVENTS; e++) {
+			if (available[e])
+				stream << "," << totals[p][e];
+			else
+				stream << ",n/a";
+		}
+		if (available[CYCLES] && available[INSTRUCTIONS] && totals[p][CYCLES] > 0)
+			stream << "," << (double)totals[p][INSTRUCTIONS] / totals[p][CYCLES];
+		else
+			stream << ",n/a";
+		for (int e = 0; e < NUM_EVENTS; e++) {
+			if (available[e] && rays > 0)
+				stream << "," << totals[p][e] * 1e6 / rays;
+			else
+				stream << ",n/a";
+		}
+		stream << "\n";
+	}
+}
+
+CounterSession::CounterSession(const std::string& path) :
+	path(path),
+	startRays(getRaysRecorded())
+{
+	if (!path.empty())
+		setCounting(true);
+}
+
+CounterSession::~CounterSession() {
+	if (path.empty())
+		return;
+	setCounting(false);
+	std::ofstream file(path);
+	writeCounters(file, getRaysRecorded() - startRays);
+}
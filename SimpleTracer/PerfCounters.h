@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+//CPU performance counters per render phase, read through Linux's perf_event_open. Each thread opens its own counter
+//group on first use, and the counts between two phase boundaries go to the innermost phase open on that thread, so
+//nested phases never count twice and work outside every phase goes uncounted. Off until enabled, when a phase scope
+//costs one flag check; enabled, each boundary is one read of the group. Counters the CPU or kernel won't give us,
+//e.g. hardware ones inside most VMs, and every counter off Linux, are reported as unavailable
+enum CounterPhase {
+	PHASE_BUILD, //Acceleration structures
+	PHASE_PRIMARY, //Camera rays to their first hit or miss
+	PHASE_BOUNCE, //Every later ray to its hit or miss
+	PHASE_SHADING, //Surface data, material sorting and scattering, including next event estimation's shadow rays
+	PHASE_OUTPUT, //Putting tiles into films, tonemapping and writing images
+	NUM_COUNTER_PHASES
+};
+
+bool isCounting();
+
+void setCounting(bool enabled);
+
+//Charges the calling thread's counts so far to the phase it was in, then starts counting towards phase
+void enterCounterPhase(CounterPhase phase);
+
+//Charges the calling thread's counts so far to its innermost phase and goes back to the one around it
+void leaveCounterPhase();
+
+//Csv of every phase's counts summed over threads, then again per million of the rays given
+void writeCounters(std::ostream& stream, uint64_t rays);
+
+//Counts towards phase from construction to destruction
+struct CounterScope {
+private:
+	bool entered;
+public:
+	explicit CounterScope(CounterPhase phase) :
+		entered(isCounting())
+	{
+		if (entered)
+			enterCounterPhase(phase);
+	}
+
+	CounterScope(const CounterScope&) = delete;
+
+	CounterScope& operator=(const CounterScope&) = delete;
+
+	~CounterScope() {
+		if (entered)
+			leaveCounterPhase();
+	}
+};
+
+//Enables counting for its lifetime and writes the counts to path when it ends, per million of the rays Telemetry.h
+//saw in between. An empty path does nothing
+struct CounterSession {
+private:
+	std::string path;
+	uint64_t startRays;
+public:
+	explicit CounterSession(const std::string& path);
+
+	CounterSession(const CounterSession&) = delete;
+
+	CounterSession& operator=(const CounterSession&) = delete;
+
+	~CounterSession();
+};
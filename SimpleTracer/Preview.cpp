@@ -0,0 +1,65 @@
+#include "Preview.h"
+#include "ThreadPool.h"
+
+Preview::Preview(const Camera& camera, FrameSink& sink, const Transform& camToWorld) :
+	camera(camera),
+	sink(sink),
+	film(camera.getResolution().x, camera.getResolution().y),
+	tiles(makeTiles(camera.getResolution())),
+	tileBuffers(getThreadPool().getNumThreads(), std::vector<Vec3f>(TILE_SIZE * TILE_SIZE)),
+	frame(camera.getResolution().x * camera.getResolution().y),
+	passes(0),
+	camToWorld(camToWorld),
+	pendingCamToWorld(camToWorld),
+	cameraVersion(0),
+	renderedVersion(0),
+	running(true)
+{}
+
+void Preview::setCamera(const Transform& camToWorld) {
+	std::lock_guard<std::mutex> lock(cameraMutex);
+	pendingCamToWorld = camToWorld;
+	cameraVersion++;
+}
+
+int Preview::renderPass() {
+	unsigned version = cameraVersion.load();
+	if (version != renderedVersion) { //Restarting is just zeroing the film
+		std::lock_guard<std::mutex> lock(cameraMutex);
+		camToWorld = pendingCamToWorld;
+		film.clear();
+		passes = 0;
+		renderedVersion = version;
+	}
+
+	SharedOrigin origin;
+	camera.prepareOrigin(camToWorld, origin);
+	expectTiles(tiles.size());
+	getThreadPool().parallelFor(tiles.size(), [&](size_t i, size_t thread) {
+		if (cameraVersion.load(std::memory_order_relaxed) != version)
+			return; //Camera moved mid pass, whatever we render now gets thrown away
+		camera.renderTile(camToWorld, tiles[i], tileBuffers[thread].data(), nullptr, &origin);
+		film.addTile(tiles[i], tileBuffers[thread].data());
+	});
+
+	if (cameraVersion.load() != version)
+		return passes; //Partial pass, the next one starts over
+
+	passes++;
+	Vec2i resolution = camera.getResolution();
+	film.tonemap(frame.data(), 1.0f / passes);
+	sink.publish(frame.data(), resolution.x, resolution.y, passes);
+	return passes;
+}
+
+void Preview::run(int maxPasses) {
+	while (running) {
+		int accumulated = renderPass();
+		if (maxPasses > 0 && accumulated >= maxPasses)
+			break;
+	}
+}
+
+void Preview::stop() {
+	running = false;
+}
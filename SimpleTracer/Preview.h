@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Camera.h"
+#include "Film.h"
+#include "FrameSink.h"
+#include "Tile.h"
+#include "Transform.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+//Renders the camera's samples-per-pixel as one pass over and over, accumulating passes in a film
+//and publishing the refined frame after each one. Meant for small resolutions and 1-4 samples a pass
+struct Preview {
+private:
+	Camera camera;
+	FrameSink& sink;
+	Film film;
+	std::vector<Tile> tiles;
+	std::vector<std::vector<Vec3f>> tileBuffers;
+	std::vector<Image::Pixel> frame;
+	int passes;
+
+	std::mutex cameraMutex;
+	Transform camToWorld;
+	Transform pendingCamToWorld;
+	std::atomic<unsigned> cameraVersion;
+	unsigned renderedVersion;
+
+	std::atomic<bool> running;
+public:
+	Preview(const Camera& camera, FrameSink& sink, const Transform& camToWorld = Transform());
+
+	//Safe from any thread. Tiles of the pass in flight are skipped and accumulation restarts from zero
+	void setCamera(const Transform& camToWorld);
+
+	//Renders and publishes one pass, returns how many passes the published frame averages
+	int renderPass();
+
+	//Renders passes until stop is called or maxPasses have accumulated, 0 means no limit
+	void run(int maxPasses = 0);
+
+	void stop();
+};
@@ -0,0 +1,102 @@
+#include "RadianceCache.h"
+#include "Random.h"
+#include <cmath>
+
+static void atomicAdd(std::atomic<float>& a, float value) {
+	float old = a.load(std::memory_order_relaxed);
+	while (!a.compare_exchange_weak(old, old + value, std::memory_order_relaxed)) {}
+}
+
+//Finalizer of splitmix64, spreads neighbouring cells across the table
+static uint64_t mix(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+RadianceCache::RadianceCache(float cellSize, size_t capacity, uint32_t minSamples) :
+	entries(),
+	capacity(1),
+	cellSize(cellSize),
+	minSamples(minSamples),
+	numCells(0)
+{
+	if (cellSize <= 0)
+		throw "Radiance cache cell size must be positive";
+	while (this->capacity < capacity)
+		this->capacity *= 2;
+	entries.reset(new Entry[this->capacity]);
+	clear();
+}
+
+//20 bits per grid coordinate, 3 for the dominant axis of the normal and its sign, and a top bit so no key is 0
+uint64_t RadianceCache::makeKey(const Poi3f& p, const Norm3f& n) const {
+	uint64_t key = 1ull << 63;
+	for (int axis = 0; axis < 3; axis++) {
+		int64_t cell = (int64_t)std::floor(p[axis] / cellSize) + (1 << 19);
+		key |= (uint64_t)(cell & 0xfffff) << (20 * axis);
+	}
+	int facing = 0;
+	for (int axis = 1; axis < 3; axis++) {
+		if (std::abs(n[axis]) > std::abs(n[facing]))
+			facing = axis;
+	}
+	return key | (uint64_t)(facing * 2 + (n[facing] < 0)) << 60;
+}
+
+RadianceCache::Entry* RadianceCache::find(uint64_t key, bool insert) const {
+	size_t mask = capacity - 1;
+	size_t slot = mix(key) & mask;
+	for (int probe = 0; probe <= MAX_PROBES; probe++, slot = (slot + 1) & mask) {
+		Entry& entry = entries[slot];
+		uint64_t found = entry.key.load(std::memory_order_acquire);
+		if (found == key)
+			return &entry;
+		if (found == 0) {
+			if (!insert)
+				return nullptr;
+			//Whoever wins the slot owns it, a loser that raced us for the same key can use it too
+			if (entry.key.compare_exchange_strong(found, key, std::memory_order_acq_rel)) {
+				numCells.fetch_add(1, std::memory_order_relaxed);
+				return &entry;
+			}
+			if (found == key)
+				return &entry;
+		}
+	}
+	return nullptr;
+}
+
+bool RadianceCache::lookup(const Poi3f& p, const Norm3f& n, Vec3f& radiance) const {
+	Vec3f jitter{ randomF() - 0.5f, randomF() - 0.5f, randomF() - 0.5f };
+	const Entry* entry = find(makeKey(p + jitter * cellSize, n), false);
+	if (entry == nullptr)
+		return false;
+	uint32_t count = entry->count.load(std::memory_order_relaxed);
+	if (count < minSamples)
+		return false;
+	for (int c = 0; c < 3; c++)
+		radiance[c] = entry->sum[c].load(std::memory_order_relaxed) / count;
+	return true;
+}
+
+void RadianceCache::record(const Poi3f& p, const Norm3f& n, const Vec3f& radiance) {
+	Entry* entry = find(makeKey(p, n), true);
+	if (entry == nullptr)
+		return;
+	for (int c = 0; c < 3; c++)
+		atomicAdd(entry->sum[c], radiance[c]);
+	entry->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RadianceCache::clear() {
+	for (size_t i = 0; i < capacity; i++) {
+		entries[i].key.store(0, std::memory_order_relaxed);
+		for (int c = 0; c < 3; c++)
+			entries[i].sum[c].store(0, std::memory_order_relaxed);
+		entries[i].count.store(0, std::memory_order_relaxed);
+	}
+	numCells.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "LinearAlg.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+//World space hash grid of light leaving diffuse surfaces, after the spatial hashing radiance caches used for real time GI.
+//Each cell is a grid cube plus the axis its surfaces face, holding the average of what paths gathered there divided by
+//albedo, so textures keep their detail. Cells are added and filled lock free by every thread at once; cellSize trades
+//blur for noise and speed, bigger cells fill sooner and answer more queries
+struct RadianceCache {
+private:
+	struct Entry {
+		std::atomic<uint64_t> key; //0 while the slot is free
+		std::atomic<float> sum[3];
+		std::atomic<uint32_t> count;
+	};
+
+	std::unique_ptr<Entry[]> entries;
+	size_t capacity;
+	float cellSize;
+	uint32_t minSamples;
+	mutable std::atomic<size_t> numCells; //Grown by finds that insert
+
+	uint64_t makeKey(const Poi3f& p, const Norm3f& n) const;
+	Entry* find(uint64_t key, bool insert) const;
+public:
+	static constexpr size_t DEFAULT_CAPACITY = 1 << 20; //Rounded up to a power of two
+	static constexpr uint32_t DEFAULT_MIN_SAMPLES = 16;
+	static constexpr int MAX_PROBES = 16; //Slots looked at past the hashed one before giving up on a full table
+
+	//Cells answer lookups once they have averaged minSamples paths, fewer makes for a faster but blotchier start
+	RadianceCache(float cellSize, size_t capacity = DEFAULT_CAPACITY, uint32_t minSamples = DEFAULT_MIN_SAMPLES);
+
+	//Albedo-free light leaving the surface at p, false if its cell has too few samples yet. The cell looked in is
+	//jittered by up to half a cell, which blends neighbouring cells over many lookups instead of showing the grid
+	bool lookup(const Poi3f& p, const Norm3f& n, Vec3f& radiance) const;
+
+	//Adds one path's estimate to the cell holding p. Dropped if the table has no room left around it
+	void record(const Poi3f& p, const Norm3f& n, const Vec3f& radiance);
+
+	//Not safe while other threads use the cache, e.g. between frames after the scene changed
+	void clear();
+
+	size_t getNumCells() const {
+		return numCells.load(std::memory_order_relaxed);
+	}
+
+	float getCellSize() const {
+		return cellSize;
+	}
+};
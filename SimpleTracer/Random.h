@@ -1,14 +1,65 @@
 #pragma once
 
 #include <random>
-#include <functional>
+#include <atomic>
+
+//Every thread gets its own generator so tiles rendered in parallel neither race nor repeat each other
+inline unsigned nextThreadSeed() {
+	static std::atomic<unsigned> seed{ 0 };
+	return seed++;
+}
+
+//The calling thread's generator, shared by every random<Type>
+inline std::mt19937& threadGenerator() {
+	thread_local std::mt19937 generator(nextThreadSeed());
+	return generator;
+}
+
+//Restarts the calling thread's generator from seed, e.g. so the numbers a tile gets depend on the tile alone
+inline void seedThreadGenerator(unsigned seed) {
+	threadGenerator().seed(seed);
+}
+
+//Stands in for the calling thread's generator while installed, e.g. a Metropolis chain replaying and mutating the
+//numbers a path was built from. next returns values in [0, 1)
+struct SampleSource {
+	virtual float next() = 0;
+
+	virtual ~SampleSource() {}
+};
+
+inline SampleSource*& currentSampleSource() {
+	thread_local SampleSource* source = nullptr;
+	return source;
+}
+
+//Installs source on the calling thread for its lifetime, putting back whatever was there before
+struct ScopedSampleSource {
+private:
+	SampleSource* previous;
+public:
+	explicit ScopedSampleSource(SampleSource* source) :
+		previous(currentSampleSource())
+	{
+		currentSampleSource() = source;
+	}
+
+	ScopedSampleSource(const ScopedSampleSource&) = delete;
+
+	ScopedSampleSource& operator=(const ScopedSampleSource&) = delete;
+
+	~ScopedSampleSource() {
+		currentSampleSource() = previous;
+	}
+};
 
 template<typename Type>
 inline Type random() {
-	static std::uniform_real_distribution<Type> distribution(0.0, 1.0);
-	static std::mt19937 generator;
-	static std::function<Type()> rand_generator = std::bind(distribution, generator);
-	return rand_generator();
+	thread_local std::uniform_real_distribution<Type> distribution(0.0, 1.0);
+	SampleSource* source = currentSampleSource();
+	if (source != nullptr)
+		return (Type)source->next();
+	return distribution(threadGenerator());
 }
 
 inline double randomD() {
@@ -17,4 +68,4 @@ inline double randomD() {
 
 inline float randomF() {
 	return random<float>();
-}
\ No newline at end of file
+}
@@ -8,23 +8,31 @@ struct Ray {
 
 	static constexpr float BIG_ASS_NUMBER = 1000000000000000000.0f;
 
+	Ray() :
+		Ray({ 0, 0, 0 }, { 0, 0, 0 })
+	{}
+
 	Ray(Poi3f org, Vec3f dir) :
 		org(org),
 		dir(dir),
 		tMax(BIG_ASS_NUMBER),
-		tMin(0)//std::numeric_limits<float>::epsilon())
+		tMin(0),//std::numeric_limits<float>::epsilon())
+		coneWidth(0),
+		coneSpread(0)
 	{}
 
 	mutable float tMin;
 	mutable float tMax;
 
-	Poi3f operator()(float t) const {
-		return org + t * dir;
+	//Ray cone standing in for ray differentials: footprint width at org and its growth per unit of distance
+	float coneWidth;
+	float coneSpread;
+
+	float footprintAt(float distance) const {
+		return coneWidth + coneSpread * distance;
 	}
 
-	const Ray& operator=(const Ray& rhs) const {
-		tMin = rhs.tMin;
-		tMax = rhs.tMax;
-		return *this;
+	Poi3f operator()(float t) const {
+		return org + t * dir;
 	}
 };
\ No newline at end of file
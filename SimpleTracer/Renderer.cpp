@@ -0,0 +1,288 @@
+#include "Renderer.h"
+#include "PerfCounters.h"
+#include "Telemetry.h"
+#include "EnvironmentMap.h"
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+//Scatter event kept until the path finishes, when the light it brought in is known and can go to the guide
+struct GuideVertex {
+	Poi3f p;
+	Vec3f dir;
+	Vec3f throughput; //Path throughput including this scatter
+	Vec3f radiance; //Path radiance when it scattered here
+	float pdf;
+};
+
+//Surface a path went on from, what it gathered after it goes to the radiance cache once the path is done
+struct CacheVertex {
+	Poi3f p;
+	Norm3f n;
+	Vec3f throughput; //Path throughput times albedo here, so the cache sees light independent of texture
+	Vec3f radiance; //Path radiance before anything was gathered here besides emission
+};
+
+//Per-thread working memory for trace, grown once and reused by every batch after
+struct TraceScratch {
+	std::vector<Hit> hits;
+	std::vector<Intersection> insects;
+	std::vector<uint32_t> active;
+	std::vector<uint32_t> sorted;
+	std::vector<uint32_t> binStart;
+	std::vector<GuideVertex> guideVertices; //MAX_DEPTH per path, only used while a guide is learning
+	std::vector<uint8_t> numGuideVertices;
+	std::vector<CacheVertex> cacheVertices; //Same layout, only used with a radiance cache
+	std::vector<uint8_t> numCacheVertices;
+	std::vector<float> scatterPdf; //Solid angle pdf of each path's last bounce, weighs the environment light it finds
+	uint64_t numRays; //Traced by this batch so far, reported once at the end
+};
+
+//Multiple importance sampling weight of a sample drawn with pdf, against one other strategy that could have drawn it
+static float powerHeuristic(float pdf, float otherPdf) {
+	float a = pdf * pdf, b = otherPdf * otherPdf;
+	return a + b > 0 ? a / (a + b) : 0;
+}
+
+template<size_t... FEATURES>
+std::array<Renderer::TraceKernel, sizeof...(FEATURES)> Renderer::makeTraceKernels(std::index_sequence<FEATURES...>) {
+	return { { &Renderer::traceKernel<FEATURES>... } };
+}
+
+void Renderer::trace(PathState* paths, size_t count, Footprint* touched, const SharedOrigin* origin) const {
+	static const std::array<TraceKernel, NUM_TRACE_KERNELS> kernels = makeTraceKernels(std::make_index_sequence<NUM_TRACE_KERNELS>());
+	(this->*kernels[getTraceFeatures(touched)])(paths, count, touched, origin);
+}
+
+unsigned Renderer::getTraceFeatures(const Footprint* touched) const {
+	unsigned features = 0;
+	if (guide != nullptr)
+		features |= TRACE_GUIDE | (guide->isLearning() ? (unsigned)TRACE_GUIDE_LEARNING : 0u);
+	if (cache != nullptr)
+		features |= TRACE_CACHE;
+	if (scene->getEnvironment() != nullptr)
+		features |= TRACE_ENVIRONMENT;
+	if (touched != nullptr)
+		features |= TRACE_FOOTPRINT;
+	return features;
+}
+
+template<unsigned FEATURES>
+void Renderer::traceKernel(PathState* paths, size_t count, Footprint* touched, const SharedOrigin* origin) const {
+	static constexpr bool LEARNING = (FEATURES & TRACE_GUIDE_LEARNING) != 0;
+	static constexpr bool CACHED = (FEATURES & TRACE_CACHE) != 0;
+	static constexpr bool ENVIRONMENT = (FEATURES & TRACE_ENVIRONMENT) != 0;
+	static constexpr bool FOOTPRINT = (FEATURES & TRACE_FOOTPRINT) != 0;
+	thread_local TraceScratch scratch;
+	scratch.hits.resize(count);
+	scratch.insects.resize(count);
+	scratch.sorted.resize(count);
+	scratch.active.resize(count);
+	scratch.scatterPdf.resize(count);
+	std::iota(scratch.active.begin(), scratch.active.end(), 0);
+	scratch.numRays = 0;
+	if (LEARNING) {
+		scratch.guideVertices.resize(count * MAX_DEPTH);
+		scratch.numGuideVertices.assign(count, 0);
+	}
+	if (CACHED) {
+		scratch.cacheVertices.resize(count * MAX_DEPTH);
+		scratch.numCacheVertices.assign(count, 0);
+	}
+
+	size_t numMaterials = scene->getNumMaterials();
+	const EnvironmentMap* environment = scene->getEnvironment();
+	auto miss = [&](PathState& path, uint32_t p, int depth) {
+		if (ENVIRONMENT) { //Past the camera, the vertex before also sampled the environment directly
+			float weight = depth == 0 ? 1 : powerHeuristic(scratch.scatterPdf[p], environment->pdf(path.ray.dir));
+			path.radiance += hadamard(path.throughput, environment->lookup(path.ray.dir)) * weight;
+		} else { //Some ambient lighting from background
+			path.radiance += hadamard(path.throughput, ambient);
+		}
+	};
+	for (int depth = 0; depth < MAX_DEPTH && !scratch.active.empty(); depth++) {
+		size_t numHit = 0;
+		scratch.numRays += scratch.active.size();
+		{
+			CounterScope traversal(depth == 0 ? PHASE_PRIMARY : PHASE_BOUNCE);
+			if (depth == 0 && origin != nullptr) {
+				for (uint32_t p : scratch.active) {
+					if (scene->intersectFrom(paths[p].ray, *origin, scratch.hits[p]))
+						scratch.active[numHit++] = p;
+					else
+						miss(paths[p], p, depth);
+				}
+			} else {
+				for (uint32_t p : scratch.active) {
+					if (scene->intersect(paths[p].ray, scratch.hits[p]))
+						scratch.active[numHit++] = p;
+					else
+						miss(paths[p], p, depth);
+				}
+			}
+		}
+		scratch.active.resize(numHit);
+		CounterScope shading(PHASE_SHADING);
+
+		//Build full surface data only for the hits that won, then counting sort them by material
+		scratch.binStart.assign(numMaterials + 1, 0);
+		for (uint32_t p : scratch.active) {
+			Intersection& insect = scratch.insects[p];
+			scene->finalize(paths[p].ray, scratch.hits[p], insect);
+			scratch.binStart[insect.materialId + 1]++;
+			if (FOOTPRINT && depth <= touched->getMaxDepth()) {
+				touched->addObject(scene->getObjectIndex(*scratch.hits[p].object));
+				touched->addMaterial(insect.materialId);
+			}
+		}
+		std::partial_sum(scratch.binStart.begin(), scratch.binStart.end(), scratch.binStart.begin());
+		for (uint32_t p : scratch.active)
+			scratch.sorted[scratch.binStart[scratch.insects[p].materialId]++] = p;
+
+		//Filling advanced each start to the next bin's start, so bin m is [binStart[m - 1], binStart[m])
+		uint32_t begin = 0;
+		for (size_t m = 0; m < numMaterials; m++) {
+			uint32_t end = scratch.binStart[m];
+			if (end > begin)
+				shadeBatch<FEATURES>(scene->getMaterial((uint32_t)m), scratch.sorted.data() + begin, end - begin, paths, scratch, depth, touched);
+			begin = end;
+		}
+
+		//Paths that ended in the cache, or scattered below their surface, have nothing left to gather
+		scratch.active.erase(std::remove_if(scratch.active.begin(), scratch.active.end(), [paths](uint32_t p) {
+			const Vec3f& throughput = paths[p].throughput;
+			return throughput[0] <= 0 && throughput[1] <= 0 && throughput[2] <= 0;
+		}), scratch.active.end());
+	}
+
+	recordRays(scratch.numRays);
+
+	//Whatever a path gathered after a vertex, divided by the throughput up to it, arrived at that vertex along its direction
+	if (LEARNING) {
+		Bounds3f bounds;
+		for (size_t p = 0; p < count; p++) {
+			for (uint8_t v = 0; v < scratch.numGuideVertices[p]; v++) {
+				const GuideVertex& vertex = scratch.guideVertices[p * MAX_DEPTH + v];
+				bounds = merge(bounds, vertex.p);
+				Vec3f gathered = paths[p].radiance - vertex.radiance;
+				Vec3f incident;
+				for (int c = 0; c < 3; c++)
+					incident[c] = vertex.throughput[c] > 0 ? gathered[c] / vertex.throughput[c] : 0;
+				guide->record(vertex.p, vertex.dir, luminance(incident), vertex.pdf);
+			}
+		}
+		guide->recordBounds(bounds);
+	}
+
+	if (CACHED) {
+		for (size_t p = 0; p < count; p++) {
+			for (uint8_t v = 0; v < scratch.numCacheVertices[p]; v++) {
+				const CacheVertex& vertex = scratch.cacheVertices[p * MAX_DEPTH + v];
+				Vec3f gathered = paths[p].radiance - vertex.radiance;
+				Vec3f leaving;
+				for (int c = 0; c < 3; c++)
+					leaving[c] = vertex.throughput[c] > 0 ? gathered[c] / vertex.throughput[c] : 0;
+				cache->record(vertex.p, vertex.n, leaving);
+			}
+		}
+	}
+}
+
+template<unsigned FEATURES>
+void Renderer::shadeBatch(const Material& mat, const uint32_t* indices, size_t count, PathState* paths, TraceScratch& scratch, int depth,
+	Footprint* touched) const {
+	static constexpr bool GUIDED = (FEATURES & TRACE_GUIDE) != 0;
+	static constexpr bool LEARNING = (FEATURES & TRACE_GUIDE_LEARNING) != 0;
+	static constexpr bool CACHED = (FEATURES & TRACE_CACHE) != 0;
+	static constexpr bool ENVIRONMENT = (FEATURES & TRACE_ENVIRONMENT) != 0;
+	static constexpr bool FOOTPRINT = (FEATURES & TRACE_FOOTPRINT) != 0;
+	const EnvironmentMap* environment = scene->getEnvironment();
+	for (size_t i = 0; i < count; i++) {
+		PathState& path = paths[indices[i]];
+		const Intersection& insect = scratch.insects[indices[i]];
+
+		//Lights the previous vertex sampled were already counted there
+		if (depth == 0 || !scene->isSampledLight(*scratch.hits[indices[i]].object))
+			path.radiance += hadamard(path.throughput, mat.light);
+		float footprint = path.ray.footprintAt(distance(path.ray.org, insect.p));
+		Vec3f albedo = mat.albedo(insect, footprint);
+
+		if (CACHED) {
+			Vec3f cached;
+			if (depth >= CACHE_MIN_DEPTH && randomF() >= CACHE_UPDATE_FRACTION && cache->lookup(insect.p, insect.n, cached)) {
+				path.radiance += hadamard(hadamard(path.throughput, albedo), cached);
+				path.throughput = { 0, 0, 0 };
+				continue;
+			}
+			scratch.cacheVertices[indices[i] * MAX_DEPTH + scratch.numCacheVertices[indices[i]]++] = { insect.p, insect.n, hadamard(path.throughput, albedo), path.radiance };
+		}
+
+		LightSample light;
+		if (scene->sampleLight(insect.p, insect.n, light)) {
+			Vec3f toLight = light.p - insect.p;
+			float dist = toLight.length();
+			Vec3f wi = toLight * (1 / dist);
+			float cosSurface = dot(wi, insect.n);
+			if (cosSurface > 0) {
+				Ray shadow{ insect.p, wi };
+				shadow.tMin = RAY_EPSILON;
+				shadow.tMax = dist * (1 - RAY_EPSILON);
+				uint32_t blocker;
+				scratch.numRays++;
+				if (!scene->occluded(shadow, blocker))
+					path.radiance += hadamard(hadamard(path.throughput, albedo), light.emission) * (DIFFUSE_BRDF_SCALE * cosSurface / light.pdf);
+				else if (FOOTPRINT && depth <= touched->getMaxDepth())
+					touched->addObject(blocker);
+			}
+			if (FOOTPRINT && depth <= touched->getMaxDepth())
+				touched->addObject(light.object);
+		}
+		const DTree* distribution = GUIDED ? guide->getDistribution(insect.p) : nullptr;
+
+		//The environment is sampled here and by scattering, each sample weighed against the other strategy's pdf
+		if (ENVIRONMENT) {
+			Vec3f wi;
+			float envPdf;
+			Vec3f incoming = environment->sample({ randomF(), randomF() }, wi, envPdf);
+			float cosSurface = dot(wi, insect.n);
+			if (envPdf > 0 && cosSurface > 0) {
+				Ray shadow{ insect.p, wi };
+				shadow.tMin = RAY_EPSILON;
+				uint32_t blocker;
+				scratch.numRays++;
+				if (!scene->occluded(shadow, blocker)) {
+					float scatterPdf = UniformHemispherePdf();
+					if (distribution != nullptr)
+						scatterPdf = GUIDE_FRACTION * distribution->pdf(wi) + (1 - GUIDE_FRACTION) * scatterPdf;
+					float weight = powerHeuristic(envPdf, scatterPdf);
+					path.radiance += hadamard(hadamard(path.throughput, albedo), incoming) * (DIFFUSE_BRDF_SCALE * cosSurface * weight / envPdf);
+				} else if (FOOTPRINT && depth <= touched->getMaxDepth()) {
+					touched->addObject(blocker);
+				}
+			}
+		}
+
+		//One sample of the mixture of material and guide, weighed by the mixture's pdf
+		Ray scattered;
+		if (distribution != nullptr && randomF() < GUIDE_FRACTION) {
+			float guidePdf;
+			scattered = Ray{ insect.p, distribution->sample(guidePdf) };
+		} else {
+			scattered = mat.getScatteredRay(insect);
+		}
+		float cost = dot(scattered.dir, insect.n);
+		float pdf = cost > 0 ? UniformHemispherePdf() : 0;
+		if (distribution != nullptr)
+			pdf = GUIDE_FRACTION * distribution->pdf(scattered.dir) + (1 - GUIDE_FRACTION) * pdf;
+		scattered.tMin = RAY_EPSILON;
+		scattered.coneWidth = footprint;
+		scattered.coneSpread = path.ray.coneSpread + DIFFUSE_CONE_SPREAD;
+
+		float weight = cost > 0 && pdf > 0 ? DIFFUSE_BRDF_SCALE * cost / pdf : 0;
+		path.throughput = hadamard(path.throughput, albedo) * weight;
+		path.ray = scattered;
+		scratch.scatterPdf[indices[i]] = pdf;
+		if (LEARNING && weight > 0)
+			scratch.guideVertices[indices[i] * MAX_DEPTH + scratch.numGuideVertices[indices[i]]++] = { insect.p, scattered.dir, path.throughput, path.radiance, pdf };
+	}
+}
@@ -4,53 +4,111 @@
 #include "Ray.h"
 #include "Intersection.h"
 #include "Scene.h"
+#include "PathGuide.h"
+#include "RadianceCache.h"
+#include "Footprint.h"
+#include <array>
+#include <utility>
 
 
 static constexpr int MAX_DEPTH = 10;
 
+//Diffuse bounces scatter over the whole hemisphere, so their ray cones open up by about this much
+static constexpr float DIFFUSE_CONE_SPREAD = 0.2f;
+
+//Diffuse reflectance as trace weighs scattered rays: albedo * cos against the 1 / 2pi pdf of a uniform hemisphere
+static constexpr float DIFFUSE_BRDF_SCALE = 1 / (2 * PI);
+
+//Secondary rays start, and shadow rays stop, this far short of their ends so they do not hit the surfaces they connect
+static constexpr float RAY_EPSILON = 1e-3f;
+
+//Share of scattered directions drawn from the path guide where it has learned something, the rest come from the material
+static constexpr float GUIDE_FRACTION = 0.5f;
+
+//Surfaces this many bounces past the camera hit and later may end their path in the radiance cache
+static constexpr int CACHE_MIN_DEPTH = 1;
+
+//Share of paths that keep tracing past a filled cache cell, so cells keep refining as more light is found
+static constexpr float CACHE_UPDATE_FRACTION = 0.1f;
+
+//Most paths trace handles at once, keeps the per-thread scratch small while batches stay big enough to sort
+static constexpr size_t PATH_BATCH_SIZE = 4096;
+
+//Optional parts of Renderer::trace. Every combination is compiled into a kernel of its own with the rest left out,
+//and trace picks one per batch instead of testing each feature on every path at every bounce
+enum TraceFeature : unsigned {
+	TRACE_GUIDE = 1, //Scatter from the path guide's mixture
+	TRACE_GUIDE_LEARNING = 2, //Record path vertices into the guide
+	TRACE_CACHE = 4,
+	TRACE_ENVIRONMENT = 8, //Sample and hit the scene's environment map instead of adding ambient
+	TRACE_FOOTPRINT = 16,
+	NUM_TRACE_KERNELS = 32
+};
+
+//One camera sample in flight, Renderer::trace advances a whole batch of them a bounce at a time
+struct PathState {
+	Ray ray;
+	Vec3f throughput;
+	Vec3f radiance;
+	uint32_t pixel; //Lets the caller know where to accumulate radiance once the path is done
+};
+
+struct TraceScratch;
 
 struct Renderer {
 private:
 	std::shared_ptr<Scene> scene;
-	Vec3f ambient = { 0.0f, 0.0f, 0.0f };// { .1f, .1f, .1f };
+	PathGuide* guide = nullptr;
+	RadianceCache* cache = nullptr;
+	Vec3f ambient = { 0.0f, 0.0f, 0.0f };// { .1f, .1f, .1f }; //Background of scenes without an environment map
+
+	using TraceKernel = void (Renderer::*)(PathState* paths, size_t count, Footprint* touched, const SharedOrigin* origin) const;
+
+	//Every kernel, indexed by TraceFeature bits
+	template<size_t... FEATURES>
+	static std::array<TraceKernel, sizeof...(FEATURES)> makeTraceKernels(std::index_sequence<FEATURES...>);
+
+	//What the current guide, cache, scene and touched call for
+	unsigned getTraceFeatures(const Footprint* touched) const;
+
+	template<unsigned FEATURES>
+	void traceKernel(PathState* paths, size_t count, Footprint* touched, const SharedOrigin* origin) const;
+
+	//Runs one material over every path that hit it this bounce, indices are into paths and the scratch arrays.
+	//Adds light sampled from the light hierarchy and the scene's environment, then scatters
+	template<unsigned FEATURES>
+	void shadeBatch(const Material& mat, const uint32_t* indices, size_t count, PathState* paths, TraceScratch& scratch, int depth,
+		Footprint* touched) const;
 public:
 	Renderer(std::shared_ptr<Scene> scene) :
 		scene(scene)
 	{}
 
-	Vec3f color(Ray& r, int depth = 0) const {
-		Vec3f c = { 0, 0, 0 };
-		if (depth >= MAX_DEPTH)
-			return c;
-
-		Intersection insect{};
-		bool hit = scene->intersect(r, &insect);
-
-		if (hit) {
-			//c = (Vec3f(insect.n) + Vec3f{ 1, 1, 1 }) / 2;
-			const Material& mat = *(insect.m);
-			c += mat.light;
-			float weight = 0;
-			Ray scattered{ mat.getScatteredRay(insect, &weight) };
-			Vec3f incoming = color(scattered, depth + 1);
-			{
-				float r = mat.color.x * incoming.x;
-				float g = mat.color.y * incoming.y;
-				float b = mat.color.z * incoming.z;
-				float cost = dot(scattered.dir, insect.n);
-				if (cost < 0)
-					cost = 0;
-				c += (Vec3f{ r, g, b } * cost);
-			}
-			float x = r.tMax;
-			//if (x == 0)
-				//std::cout << "NANI?";
-			float y = x / (1 + x);
-			//c = { y, y, y };
-		} else { //Some ambient lighting from background
-			c += ambient;
-		}
-		return c;
+	//Scattering mixes in directions from guide wherever it has a distribution, and records into it while it is learning
+	void setGuide(PathGuide* guide) {
+		this->guide = guide;
+	}
+
+	//Paths past CACHE_MIN_DEPTH end where cache can answer for the light leaving the surface, and every vertex
+	//traced in full feeds it. Biased by the cache's cell size in exchange for far shorter paths
+	void setRadianceCache(RadianceCache* cache) {
+		this->cache = cache;
+	}
+
+	//Traces the paths to completion. Each bounce intersects every live path, then sorts the
+	//hits by material so every material is shaded over one contiguous batch. With touched, also adds every object
+	//the paths hit, light they sampled or shadow ray blocker they met, and every material they shaded, up to its max depth.
+	//With origin, every path must start at origin.org, and their first intersections reuse its precomputed terms
+	void trace(PathState* paths, size_t count, Footprint* touched = nullptr, const SharedOrigin* origin = nullptr) const;
+
+	const Scene& getScene() const {
+		return *scene;
+	}
+
+	Vec3f color(const Ray& r) const {
+		PathState path{ r, { 1, 1, 1 }, { 0, 0, 0 }, 0 };
+		trace(&path, 1);
+		return path.radiance;
 	}
 
 	void derps() {
@@ -66,4 +124,4 @@ public:
 			color = a * color + (1 - a) * reflectionColor;
 		}*/
 	}
-};
\ No newline at end of file
+};
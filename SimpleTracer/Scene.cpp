@@ -0,0 +1,79 @@
+#include "Scene.h"
+#include "SceneBuilder.h"
+#include "Random.h"
+#include "ThreadPool.h"
+
+Scene::Scene(SceneBuilder&& builder) :
+	arena(std::move(builder.arena)),
+	shapes(std::move(builder.shapes)),
+	objects(std::move(builder.objects)),
+	materials(std::move(builder.materials)),
+	objectBounds(objects.size())
+{
+	for (size_t n = 0; n < objects.size(); n++)
+		objectBounds[n] = objects[n].worldBound();
+	rebuild();
+	buildLights();
+}
+
+void Scene::buildLights() {
+	//Every light piece of an emissive object with an area to sample is a light
+	std::vector<LightBounds> lights;
+	lightPieces.clear();
+	sampledLight.assign(objects.size(), false);
+	for (uint32_t n = 0; n < objects.size(); n++) {
+		float emitted = luminance(materials[objects[n].materialId].light);
+		if (emitted <= 0)
+			continue;
+		if (objects[n].getScale() == 0)
+			throw "Emissive objects can only be placed by rotations, translations and uniform scales";
+		for (uint32_t piece = 0; piece < objects[n].numLightPieces(); piece++) {
+			float power = emitted * objects[n].area(piece);
+			if (power <= 0)
+				continue;
+			lights.push_back({ objects[n].worldBound(piece), power, objects[n].worldNormalBounds(piece), 0 });
+			lightPieces.push_back({ n, piece });
+			sampledLight[n] = true;
+		}
+	}
+	lightBvh.build(lights);
+}
+
+bool Scene::sampleLight(const Poi3f& p, const Norm3f& n, LightSample& sample) const {
+	uint32_t light;
+	float pmf;
+	if (!lightBvh.sample(p, n, randomF(), light, pmf))
+		return false;
+	const Object& object = objects[lightPieces[light].first];
+	float pdf = object.sampleSurface(lightPieces[light].second, p, Poi2f{ randomF(), randomF() }, sample.p, sample.n);
+	if (pdf <= 0)
+		return false;
+	sample.emission = materials[object.materialId].light;
+	sample.pdf = pdf * pmf;
+	sample.object = lightPieces[light].first;
+	return true;
+}
+
+std::shared_ptr<Scene> Scene::clone() const {
+	SceneBuilder builder;
+	builder.shapes.reserve(shapes.size());
+	for (const Shape* shape : shapes)
+		builder.shapes.push_back(shape->clone(builder.arena));
+	builder.materials = materials;
+	builder.objects = objects;
+	for (Object& object : builder.objects)
+		object.shape = builder.shapes[object.shapeHandle.index];
+	std::shared_ptr<Scene> copy = builder.build();
+	copy->environment = environment;
+	return copy;
+}
+
+void Scene::update() {
+	getThreadPool().parallelFor(objects.size(), [this](size_t n, size_t) {
+		objectBounds[n] = objects[n].worldBound();
+	});
+	bvh.refit(objectBounds);
+	if (bvh.sahCost() > REBUILD_COST_RATIO * builtCost)
+		rebuild();
+	buildLights();
+}
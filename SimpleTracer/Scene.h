@@ -4,22 +4,155 @@
 #include "Object.h"
 #include "Ray.h"
 #include "Intersection.h"
+#include "BVH.h"
+#include "LightBVH.h"
+#include "Arena.h"
+#include <memory>
+#include <utility>
+#include <vector>
+
+struct SceneBuilder;
+struct EnvironmentMap;
+
+//Point picked on an emitter for a shading point
+struct LightSample {
+	Poi3f p;
+	Norm3f n;
+	Vec3f emission;
+	float pdf; //With respect to solid angle at the shading point, including the odds of picking this light
+	uint32_t object; //Emitter the point is on
+};
+
+//Origin dependent terms of every object of a scene for rays that all leave org, e.g. one camera's primary rays.
+//Goes stale when org moves or the scene is updated
+struct SharedOrigin {
+	Poi3f org;
+	std::vector<OriginTerms> objects; //Indexed like the scene's objects
+};
 
 struct Scene : public Hittable {
 private:
-	std::vector<std::shared_ptr<Object>> objects;
+	Arena arena; //Owns every shape, all released together with the scene
+	std::vector<Shape*> shapes; //Indexed by ShapeHandle
+	std::vector<Object> objects; //Indexed by ObjectHandle, also the primitives of the hierarchy
+	std::vector<Material> materials; //Indexed by MaterialHandle, which objects hand out as material ids
+	std::vector<Bounds3f> objectBounds;
+	BVH bvh;
+	LightBVH lightBvh;
+	std::vector<std::pair<uint32_t, uint32_t>> lightPieces; //Object and light piece of each light in lightBvh
+	std::vector<bool> sampledLight; //Per object, whether sampleLight can return it
+	std::shared_ptr<const EnvironmentMap> environment; //Light from rays that leave the scene, if any
+	float builtCost;
+	size_t numRebuilds = 0;
+
+	void rebuild() {
+		bvh.build(objectBounds);
+		builtCost = bvh.sahCost();
+		numRebuilds++;
+	}
+
+	void buildLights();
 public:
-	Scene(std::vector<std::shared_ptr<Object>> objs) :
-		objects(objs)
-	{}
+	//Refits that make the tree this much more expensive than when built trigger a rebuild
+	static constexpr float REBUILD_COST_RATIO = 1.5f;
+
+	//Use SceneBuilder::build
+	explicit Scene(SceneBuilder&& builder);
+
+	size_t getNumMaterials() const {
+		return materials.size();
+	}
+
+	const Material& getMaterial(uint32_t id) const {
+		return materials[id];
+	}
 
-	bool intersect(const Ray& r, Intersection* insect) const {
-		bool hit = false;
-		for (size_t n = 0; n < objects.size(); n++) {
-			bool h = objects[n]->intersect(r, insect);
-			hit = hit ? true : h;
-		}
+	Material& getMaterial(uint32_t id) {
+		return materials[id];
+	}
+
+	const EnvironmentMap* getEnvironment() const {
+		return environment.get();
+	}
+
+	//Shared rather than copied by clone, maps never change once loaded
+	void setEnvironment(std::shared_ptr<const EnvironmentMap> environment) {
+		this->environment = std::move(environment);
+	}
+
+	//Deep copy of shapes, objects, material table and hierarchy, allocated by the calling thread
+	std::shared_ptr<Scene> clone() const;
+
+	size_t getNumObjects() const {
+		return objects.size();
+	}
+
+	Object& getObject(size_t n) {
+		return objects[n];
+	}
+
+	//Index of an object of this scene, e.g. the one a Hit refers to
+	uint32_t getObjectIndex(const Object& object) const {
+		return (uint32_t)(&object - objects.data());
+	}
+
+	size_t getNumRebuilds() const {
+		return numRebuilds;
+	}
+
+	//Picks an emitter point for shading point p with normal n, favouring lights likely to contribute the most there
+	bool sampleLight(const Poi3f& p, const Norm3f& n, LightSample& sample) const;
+
+	//Whether paths that hit this object already got its light through sampleLight at the previous vertex
+	bool isSampledLight(const Object& object) const {
+		return sampledLight[getObjectIndex(object)];
+	}
+
+	//Call after moving objects. Refits the hierarchy in parallel and only rebuilds it once refitting has degraded it too far
+	void update();
+
+	using Hittable::intersect;
+
+	bool intersect(const Ray& r, Hit& hit) const {
+		return bvh.intersect(r, [&](uint32_t n) {
+			return objects[n].intersect(r, hit);
+		});
+	}
+
+	//Fills origin in for rays leaving org, once instead of again for every one of them
+	void prepareOrigin(const Poi3f& org, SharedOrigin& origin) const {
+		origin.org = org;
+		origin.objects.resize(objects.size());
+		for (size_t n = 0; n < objects.size(); n++)
+			objects[n].prepareOrigin(org, origin.objects[n]);
+	}
+
+	//Same as intersect for a ray starting at origin.org
+	bool intersectFrom(const Ray& r, const SharedOrigin& origin, Hit& hit) const {
+		return bvh.intersect(r, [&](uint32_t n) {
+			return objects[n].intersectFrom(r, origin.objects[n], hit);
+		});
+	}
+
+	using Hittable::occluded;
+
+	bool occluded(const Ray& r) const {
+		return bvh.occluded(r, [&](uint32_t n) {
+			return objects[n].occluded(r);
+		});
+	}
+
+	//Same, also telling which object was in the way
+	bool occluded(const Ray& r, uint32_t& blocker) const {
+		return bvh.occluded(r, [&](uint32_t n) {
+			if (!objects[n].occluded(r))
+				return false;
+			blocker = n;
+			return true;
+		});
+	}
 
-		return hit;
+	void finalize(const Ray& r, const Hit& hit, Intersection& insect) const {
+		hit.object->finalize(r, hit, insect);
 	}
-};
\ No newline at end of file
+};
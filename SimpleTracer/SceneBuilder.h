@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Arena.h"
+#include "Object.h"
+#include "Material.h"
+#include "Scene.h"
+#include "TriangleMesh.h"
+#include <memory>
+#include <utility>
+#include <vector>
+
+//Collects materials, shapes and objects for a Scene. Shapes go straight into the arena the scene will own,
+//objects and materials into flat tables, and everything is referred to by 32 bit handles
+struct SceneBuilder {
+private:
+	friend struct Scene;
+
+	Arena arena;
+	std::vector<Shape*> shapes;
+	std::vector<Object> objects;
+	std::vector<Material> materials;
+public:
+	//Avoids regrowing the tables while adding a known number of objects
+	void reserve(size_t numObjects) {
+		shapes.reserve(numObjects);
+		objects.reserve(numObjects);
+	}
+
+	MaterialHandle addMaterial(const Material& material) {
+		materials.push_back(material);
+		return { (uint32_t)(materials.size() - 1) };
+	}
+
+	template<typename T, typename... Args>
+	ShapeHandle addShape(Args&&... args) {
+		shapes.push_back(arena.create<T>(std::forward<Args>(args)...));
+		return { (uint32_t)(shapes.size() - 1) };
+	}
+
+	//Copies the geometry into the scene's arena, every 3 indexes make a triangle
+	ShapeHandle addTriangleMesh(const Poi3f* positions, int numVerts, const int* indexes, int numTris) {
+		shapes.push_back(arena.create<TriangleMesh>(arena, positions, numVerts, indexes, numTris));
+		return { (uint32_t)(shapes.size() - 1) };
+	}
+
+	ObjectHandle addObject(ShapeHandle shape, MaterialHandle material) {
+		return addObject(Transform(), shape, material);
+	}
+
+	ObjectHandle addObject(const Transform& fromObject, ShapeHandle shape, MaterialHandle material) {
+		if (shape.index >= shapes.size() || material.index >= materials.size())
+			throw "Object refers to a shape or material that was not added";
+		objects.emplace_back(fromObject, shape, shapes[shape.index], material);
+		return { (uint32_t)(objects.size() - 1) };
+	}
+
+	//Hands everything to the scene, the builder is empty afterwards
+	std::shared_ptr<Scene> build() {
+		return std::make_shared<Scene>(std::move(*this));
+	}
+};
@@ -0,0 +1,72 @@
+#include "Scenes.h"
+#include "Sphere.h"
+#include "Object.h"
+#include "Material.h"
+#include "SceneBuilder.h"
+#include "EnvironmentMap.h"
+
+std::shared_ptr<Scene> makeDefaultScene() {
+	SceneBuilder builder;
+	MaterialHandle matte = builder.addMaterial(Material{ Vec3f{ 0.8f, 0.8f, 0.8f } });
+	MaterialHandle matte2 = builder.addMaterial(Material{ Vec3f{ 0.2f, 0.5f, 0.2f } });
+	MaterialHandle light = builder.addMaterial(Material{ Vec3f{ 0.0f, 0.0f, 0.0f }, Vec3f{ 1.0f, 1.0f, 1.0f } });
+	MaterialHandle light2 = builder.addMaterial(Material{ Vec3f{ 0.3f, 0.3f, 0.3f }, Vec3f{ 0.7f, 0.7f, 1.0f } });
+
+	
+
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 0.0f, -101.0f, -5.0f }, 100.0f), matte2);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 0.0f, 1.0f, -5.0f }, 2.0f), matte);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 0.0, 80.0f, 0.0f }, 50.0f), light2);
+	/*objects.emplace_back(new Sphere({ 0, 1, -5 }, 1));
+	objects.emplace_back(new Sphere({ 5, 1, -5 }, 1));
+	objects.emplace_back(new Sphere({ -5, 1, -5 }, 1));
+	objects.emplace_back(new Sphere({ -5, 5, -5 }, 1));*/
+	return builder.build();
+}
+
+std::shared_ptr<Scene> makeIndoorScene() {
+	SceneBuilder builder;
+	MaterialHandle white = builder.addMaterial(Material{ Vec3f{ 0.75f, 0.75f, 0.75f } });
+	MaterialHandle red = builder.addMaterial(Material{ Vec3f{ 0.75f, 0.25f, 0.25f } });
+	MaterialHandle green = builder.addMaterial(Material{ Vec3f{ 0.25f, 0.75f, 0.25f } });
+	MaterialHandle light = builder.addMaterial(Material{ Vec3f{ 0.0f, 0.0f, 0.0f }, Vec3f{ 400.0f, 380.0f, 340.0f } });
+
+	//Walls are spheres big enough to look flat from inside the room
+	const float wall = 1000.0f;
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 0.0f, -1.0f - wall, -5.0f }, wall), white);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 0.0f, 5.0f + wall, -5.0f }, wall), white);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ -4.0f - wall, 2.0f, -5.0f }, wall), red);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 4.0f + wall, 2.0f, -5.0f }, wall), green);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 0.0f, 2.0f, -12.0f - wall }, wall), white);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 0.0f, 2.0f, 2.0f + wall }, wall), white);
+
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 0.0f, 0.0f, -6.0f }, 1.0f), white);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 2.5f, 3.5f, -9.0f }, 0.9f), white); //Shields the room from the light
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 2.5f, 4.65f, -9.0f }, 0.2f), light);
+	return builder.build();
+}
+
+std::shared_ptr<Scene> makeOutdoorScene() {
+	SceneBuilder builder;
+	MaterialHandle ground = builder.addMaterial(Material{ Vec3f{ 0.5f, 0.45f, 0.4f } });
+	MaterialHandle white = builder.addMaterial(Material{ Vec3f{ 0.8f, 0.8f, 0.8f } });
+	MaterialHandle blue = builder.addMaterial(Material{ Vec3f{ 0.2f, 0.3f, 0.7f } });
+
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 0.0f, -1001.0f, -5.0f }, 1000.0f), ground);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 0.0f, 0.0f, -5.0f }, 1.0f), white);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ -2.5f, -0.5f, -6.0f }, 0.5f), blue);
+	builder.addObject(builder.addShape<Sphere>(Poi3f{ 2.0f, -0.3f, -4.0f }, 0.7f), white);
+	std::shared_ptr<Scene> scene = builder.build();
+	scene->setEnvironment(std::make_shared<EnvironmentMap>(EnvironmentMap::makeSky(Vec3f{ 0.5f, 0.6f, 0.3f })));
+	return scene;
+}
+
+std::shared_ptr<Scene> makeScene(const std::string& name) {
+	if (name == "default")
+		return makeDefaultScene();
+	if (name == "indoor")
+		return makeIndoorScene();
+	if (name == "outdoor")
+		return makeOutdoorScene();
+	throw "Unknown scene";
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Scene.h"
+#include <memory>
+#include <string>
+
+//Builds the demo scene; every process of a distributed render calls this to load the same scene
+std::shared_ptr<Scene> makeDefaultScene();
+
+//Closed room whose only light hides above a shield, so nearly everything is lit indirectly off the ceiling
+std::shared_ptr<Scene> makeIndoorScene();
+
+//Spheres on open ground lit only by a sky with a small bright sun, see EnvironmentMap::makeSky
+std::shared_ptr<Scene> makeOutdoorScene();
+
+//"default", "indoor" or "outdoor", throws for anything else
+std::shared_ptr<Scene> makeScene(const std::string& name);
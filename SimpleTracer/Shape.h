@@ -3,10 +3,84 @@
 #include "Transform.h"
 #include "Ray.h"
 #include "Intersection.h"
+#include "Bounds.h"
+#include "Arena.h"
+
+//What a shape can work out ahead of time about rays that all leave one object space point, e.g. a camera's
+//primary rays. org is filled in by the caller, the rest is up to the shape
+struct OriginTerms {
+	Poi3f org;
+	Vec3f offset;
+	float constant;
+};
 
 class Shape {
 public:
-	virtual bool intersect(const Ray& r, Intersection* insect = nullptr) const = 0;
+	//Same split as Hittable: intersect fills hit.t, hit.primId and hit.b and nothing else, finalize does the rest in object space
+	virtual bool intersect(const Ray& r, Hit& hit) const = 0;
+	virtual void finalize(const Ray& r, const Hit& hit, Intersection& insect) const = 0;
+	virtual Bounds3f objectBound() const = 0;
+
+	//Deep copy allocated from arena, for replicating scenes into other memory
+	virtual Shape* clone(Arena& arena) const = 0;
+
+	//Any hit within [r.tMin, r.tMax], leaves the ray alone
+	virtual bool occluded(const Ray& r) const = 0;
+
+	//Fills in the terms intersectFrom reuses for every ray leaving terms.org
+	virtual void prepareOrigin(OriginTerms&) const {}
+
+	//Same as intersect for a ray starting at terms.org, skipping the work that only depends on it
+	virtual bool intersectFrom(const Ray& r, const OriginTerms&, Hit& hit) const {
+		return intersect(r, hit);
+	}
+
+	//Surface area in object space, shapes without one cannot be sampled as lights
+	virtual float area() const {
+		return 0;
+	}
+
+	//Picks a point on the surface as seen from ref, returns its pdf with respect to solid angle at ref or 0 if there is none
+	virtual float sample(const Poi3f&, const Poi2f&, Poi3f&, Norm3f&) const {
+		return 0;
+	}
+
+	//Which way the surface faces, lets the light hierarchy rule out emitters turned away from a point
+	virtual DirectionCone normalBounds() const {
+		return DirectionCone::entireSphere();
+	}
+
+	//Emitting shapes go into the light hierarchy as this many pieces, each bounded and sampled on its own, e.g. a
+	//mesh's triangles. By default the whole shape is the one piece
+	virtual uint32_t numLightPieces() const {
+		return 1;
+	}
+
+	virtual Bounds3f pieceBound(uint32_t) const {
+		return objectBound();
+	}
+
+	virtual float pieceArea(uint32_t) const {
+		return area();
+	}
+
+	virtual float samplePiece(uint32_t, const Poi3f& ref, const Poi2f& u, Poi3f& p, Norm3f& n) const {
+		return sample(ref, u, p, n);
+	}
+
+	virtual DirectionCone pieceNormalBounds(uint32_t) const {
+		return normalBounds();
+	}
+
+	bool intersect(const Ray& r, Intersection* insect = nullptr) const {
+		Hit hit;
+		if (!intersect(r, hit))
+			return false;
+		if (insect != nullptr)
+			finalize(r, hit, *insect);
+		return true;
+	}
+
 	virtual ~Shape() {}
 private:
 };
@@ -0,0 +1,172 @@
+#include "Socket.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static const Socket::Handle INVALID_HANDLE = INVALID_SOCKET;
+static const int SEND_FLAGS = 0;
+
+static struct WinsockInit {
+	WinsockInit() {
+		WSADATA data;
+		WSAStartup(MAKEWORD(2, 2), &data);
+	}
+
+	~WinsockInit() {
+		WSACleanup();
+	}
+} winsockInit;
+
+static void closeHandle(Socket::Handle h) {
+	closesocket(h);
+}
+
+static void keepFromChildren(Socket::Handle h) {
+	SetHandleInformation((HANDLE)h, HANDLE_FLAG_INHERIT, 0);
+}
+#else
+static const Socket::Handle INVALID_HANDLE = -1;
+static const int SEND_FLAGS = MSG_NOSIGNAL; //A dead peer should fail the send, not kill the process
+
+static void closeHandle(Socket::Handle h) {
+	::close(h);
+}
+
+static void keepFromChildren(Socket::Handle h) {
+	fcntl(h, F_SETFD, fcntl(h, F_GETFD) | FD_CLOEXEC);
+}
+#endif
+
+//Processes we spawn, e.g. distributed workers, would otherwise hold our sockets open after we close them: a listener
+//keeps accepting into its backlog and a connection never shows its peer that we hung up
+static Socket::Handle openHandle() {
+	Socket::Handle h = (Socket::Handle)::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (h != INVALID_HANDLE)
+		keepFromChildren(h);
+	return h;
+}
+
+Socket::Socket() :
+	handle(INVALID_HANDLE)
+{}
+
+Socket::Socket(Socket&& other) :
+	handle(other.handle)
+{
+	other.handle = INVALID_HANDLE;
+}
+
+Socket& Socket::operator=(Socket&& other) {
+	if (this != &other) {
+		close();
+		handle = other.handle;
+		other.handle = INVALID_HANDLE;
+	}
+	return *this;
+}
+
+Socket::~Socket() {
+	close();
+}
+
+Socket Socket::listen(uint16_t port, int backlog) {
+	Socket s{ openHandle() };
+	if (!s.isValid())
+		throw "Could not create socket";
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (::bind(s.handle, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(s.handle, backlog) != 0)
+		throw "Could not listen on socket";
+	return s;
+}
+
+Socket Socket::connect(const std::string& host, uint16_t port) {
+	Socket s{ openHandle() };
+	if (!s.isValid())
+		throw "Could not create socket";
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+		throw "Invalid host address";
+	if (::connect(s.handle, (sockaddr*)&addr, sizeof(addr)) != 0)
+		throw "Could not connect to host";
+
+	int noDelay = 1; //Tile requests are tiny, don't let Nagle sit on them
+	setsockopt(s.handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+	return s;
+}
+
+Socket Socket::accept() const {
+	Socket s{ (Handle)::accept(handle, nullptr, nullptr) };
+	if (s.isValid()) {
+		keepFromChildren(s.handle);
+		int noDelay = 1;
+		setsockopt(s.handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+	}
+	return s;
+}
+
+uint16_t Socket::getPort() const {
+	sockaddr_in addr{};
+	socklen_t len = sizeof(addr);
+	if (getsockname(handle, (sockaddr*)&addr, &len) != 0)
+		return 0;
+	return ntohs(addr.sin_port);
+}
+
+bool Socket::isValid() const {
+	return handle != INVALID_HANDLE;
+}
+
+bool Socket::sendAll(const void* data, size_t size) const {
+	const char* bytes = (const char*)data;
+	while (size > 0) {
+		int sent = ::send(handle, bytes, (int)std::min<size_t>(size, 1 << 30), SEND_FLAGS);
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+bool Socket::recvAll(void* data, size_t size) const {
+	char* bytes = (char*)data;
+	while (size > 0) {
+		int received = ::recv(handle, bytes, (int)std::min<size_t>(size, 1 << 30), 0);
+		if (received <= 0) //Zero means the peer hung up
+			return false;
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+int Socket::recvSome(void* data, size_t size) const {
+	return ::recv(handle, (char*)data, (int)std::min<size_t>(size, 1 << 30), 0);
+}
+
+void Socket::close() {
+	if (isValid()) {
+		closeHandle(handle);
+		handle = INVALID_HANDLE;
+	}
+}
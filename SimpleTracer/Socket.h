@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+//Blocking TCP socket over Winsock or BSD sockets, just enough to talk to processes on the same box
+struct Socket {
+#ifdef _WIN32
+	using Handle = uintptr_t;
+#else
+	using Handle = int;
+#endif
+private:
+	Handle handle;
+
+	explicit Socket(Handle handle) :
+		handle(handle)
+	{}
+public:
+	Socket();
+
+	Socket(Socket&& other);
+
+	Socket& operator=(Socket&& other);
+
+	Socket(const Socket&) = delete;
+
+	Socket& operator=(const Socket&) = delete;
+
+	~Socket();
+
+	//Port 0 lets the OS pick a free port, see getPort
+	static Socket listen(uint16_t port, int backlog = 16);
+
+	static Socket connect(const std::string& host, uint16_t port);
+
+	//Returns an invalid socket on failure
+	Socket accept() const;
+
+	uint16_t getPort() const;
+
+	bool isValid() const;
+
+	bool sendAll(const void* data, size_t size) const;
+
+	bool recvAll(void* data, size_t size) const;
+
+	//Whatever has arrived, up to size bytes. Returns how many, 0 once the peer hung up or negative on errors
+	int recvSome(void* data, size_t size) const;
+
+	void close();
+};
@@ -15,7 +15,59 @@ public:
 		radius(radius)
 	{}
 
-	bool intersect(const Ray& ray, Intersection* insect = nullptr) const {
+	Bounds3f objectBound() const {
+		Vec3f extent{ radius, radius, radius };
+		return { center - extent, center + extent };
+	}
+
+	Shape* clone(Arena& arena) const {
+		return arena.create<Sphere>(*this);
+	}
+
+	float area() const {
+		return 4 * PI * radius * radius;
+	}
+
+	//Samples the cap visible from ref uniformly by solid angle, or the whole sphere by area from inside it
+	float sample(const Poi3f& ref, const Poi2f& u, Poi3f& p, Norm3f& n) const {
+		float z = 1 - 2 * u[0];
+		float r = std::sqrt(std::max(0.0f, 1 - z * z));
+		float phi = 2 * PI * u[1];
+		Vec3f wc = center - ref;
+		float dc2 = wc.lengthSq();
+		if (dc2 <= radius * radius) {
+			Vec3f d{ r * std::cos(phi), r * std::sin(phi), z };
+			p = center + radius * d;
+			n = Norm3f(d);
+			Vec3f wi = p - ref;
+			float dist2 = wi.lengthSq();
+			float cosLight = std::abs(dot(d, wi)) / std::sqrt(dist2);
+			return dist2 > 0 && cosLight > 0 ? dist2 / (cosLight * area()) : 0;
+		}
+
+		float dc = std::sqrt(dc2);
+		float sinThetaMax2 = radius * radius / dc2;
+		float cosThetaMax = std::sqrt(std::max(0.0f, 1 - sinThetaMax2));
+		float oneMinusCosThetaMax = sinThetaMax2 < 0.00068523f ? sinThetaMax2 / 2 : 1 - cosThetaMax; //Keeps precision for far away spheres
+
+		float cosTheta = 1 - u[0] * oneMinusCosThetaMax;
+		float sinTheta2 = std::max(0.0f, 1 - cosTheta * cosTheta);
+		float ds = dc * cosTheta - std::sqrt(std::max(0.0f, radius * radius - dc2 * sinTheta2));
+		float cosAlpha = (dc2 + radius * radius - ds * ds) / (2 * dc * radius);
+		float sinAlpha = std::sqrt(std::max(0.0f, 1 - cosAlpha * cosAlpha));
+
+		Vec3f wz = wc * (1 / dc);
+		Vec3f wx = normalize(cross(std::abs(wz.x) > 0.9f ? Vec3f{ 0, 1, 0 } : Vec3f{ 1, 0, 0 }, wz));
+		Vec3f wy = cross(wz, wx);
+		Vec3f d = -(sinAlpha * std::cos(phi) * wx + sinAlpha * std::sin(phi) * wy + cosAlpha * wz);
+		p = center + radius * d;
+		n = Norm3f(d);
+		return 1 / (2 * PI * oneMinusCosThetaMax);
+	}
+
+	using Shape::intersect;
+
+	bool intersect(const Ray& ray, Hit& hit) const {
 		Vec3f oc = ray.org - center;
 		float a = dot(ray.dir, ray.dir);
 		float b = dot(oc, ray.dir);
@@ -31,33 +83,77 @@ public:
 				return false; //Solutions aren't in valid range
 		}
 
-		if (insect != nullptr) { //Populate intersection data if possible
-			insect->wo = -ray.dir; //Wo is back towards incoming direction
-			Poi3f p = (insect->p = ray(t)); //Intersection point is t dist along ray
-			Vec3f delta = p - center; //To account for sphere not being centered at origin
-			insect->n = Norm3f{ normalize(delta) }; //Direction from center to point is normal direction			
-			float theta = acos(delta.z / radius); //Theta in range [0, PI]
-			float v = theta / PI;
-
-			float phi = (PI / 2) - atan(delta.x / delta.y); //Phi in range [0, PI]
-			if (delta.y < 0) //Extends range to [0, 2PI] by checking if sin(real phi) is negitive
-				phi += PI;
-
-			//cot^-1(x/y) might be undefined if 
-			if (v == 0 || v == 1) { //at poles of sphere
-				phi = 0;
-			}
-			else if (delta.y == 0) { // or y is otherwise zero
-				phi = delta.x > 0 ? 0 : PI;
-			}
-
-			float u = phi / (2 * PI);
-
-			insect->uv = { u, v };
-			insect->dpdu = { delta.y * 2 * PI, delta.x * 2 * PI, 0 };
-			insect->dpdv = { delta.z * cos(phi) * PI, delta.z * sin(phi) * PI, -radius * sin(theta) * PI };
+		hit.t = t;
+		hit.primId = 0;
+		ray.tMax = t;
+		return true;
+	}
+
+	void prepareOrigin(OriginTerms& terms) const {
+		terms.offset = terms.org - center;
+		terms.constant = dot(terms.offset, terms.offset) - radius * radius;
+	}
+
+	//oc and the quadratic's c term come from terms, leaving two dot products per ray
+	bool intersectFrom(const Ray& ray, const OriginTerms& terms, Hit& hit) const {
+		float a = dot(ray.dir, ray.dir);
+		float b = dot(terms.offset, ray.dir);
+		float discriminant = b * b - a * terms.constant;
+		if (discriminant < 0)
+			return false;
+
+		float t = (-b - sqrt(discriminant)) / a;
+		if (t >= ray.tMax || t <= ray.tMin) {
+			t = (-b + sqrt(discriminant)) / a;
+			if (t >= ray.tMax || t <= ray.tMin)
+				return false;
 		}
+
+		hit.t = t;
+		hit.primId = 0;
 		ray.tMax = t;
 		return true;
 	}
+
+	bool occluded(const Ray& ray) const {
+		Vec3f oc = ray.org - center;
+		float a = dot(ray.dir, ray.dir);
+		float b = dot(oc, ray.dir);
+		float c = dot(oc, oc) - radius * radius;
+		float discriminant = b * b - a * c;
+		if (discriminant < 0)
+			return false;
+
+		float root = sqrt(discriminant);
+		float t0 = (-b - root) / a;
+		float t1 = (-b + root) / a;
+		return (t0 < ray.tMax && t0 > ray.tMin) || (t1 < ray.tMax && t1 > ray.tMin);
+	}
+
+	void finalize(const Ray& ray, const Hit& hit, Intersection& insect) const {
+		insect.wo = -ray.dir; //Wo is back towards incoming direction
+		Poi3f p = (insect.p = ray(hit.t)); //Intersection point is t dist along ray
+		Vec3f delta = p - center; //To account for sphere not being centered at origin
+		insect.n = Norm3f{ normalize(delta) }; //Direction from center to point is normal direction			
+		float theta = acos(delta.z / radius); //Theta in range [0, PI]
+		float v = theta / PI;
+
+		float phi = (PI / 2) - atan(delta.x / delta.y); //Phi in range [0, PI]
+		if (delta.y < 0) //Extends range to [0, 2PI] by checking if sin(real phi) is negitive
+			phi += PI;
+
+		//cot^-1(x/y) might be undefined if 
+		if (v == 0 || v == 1) { //at poles of sphere
+			phi = 0;
+		}
+		else if (delta.y == 0) { // or y is otherwise zero
+			phi = delta.x > 0 ? 0 : PI;
+		}
+
+		float u = phi / (2 * PI);
+
+		insect.uv = { u, v };
+		insect.dpdu = { -delta.y * 2 * PI, delta.x * 2 * PI, 0 };
+		insect.dpdv = { delta.z * cos(phi) * PI, delta.z * sin(phi) * PI, -radius * sin(theta) * PI };
+	}
 };
\ No newline at end of file
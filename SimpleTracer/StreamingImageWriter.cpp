@@ -0,0 +1,98 @@
+#include "StreamingImageWriter.h"
+#include "Film.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+
+StreamingImageWriter::StreamingImageWriter(const std::string& path, int width, int height, size_t maxTilesInFlight) :
+	file(path, std::ofstream::binary),
+	width(width),
+	height(height),
+	maxTilesInFlight(maxTilesInFlight)
+{
+	file << "P6\n" << width << " " << height << "\n255\n";
+	headerSize = file.tellp();
+
+	//Extend to the full size so tiles can land anywhere, filesystems with sparse files skip the gap
+	std::streamoff size = headerSize + (std::streamoff)width * height * sizeof(Image::Pixel);
+	file.seekp(size - 1);
+	file.put(0);
+	if (!file)
+		throw "Could not create streamed image file";
+
+	ioThread = std::thread(&StreamingImageWriter::ioLoop, this);
+}
+
+StreamingImageWriter::~StreamingImageWriter() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finishing = true;
+	}
+	changed.notify_all();
+	if (ioThread.joinable())
+		ioThread.join();
+}
+
+void StreamingImageWriter::write(const Tile& tile, const Vec3f* radiance) {
+	std::vector<Image::Pixel> pixels;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return inFlight < maxTilesInFlight || failed; });
+		if (failed)
+			return;
+		inFlight++;
+		if (!freeBuffers.empty()) {
+			pixels.swap(freeBuffers.back());
+			freeBuffers.pop_back();
+		}
+	}
+
+	pixels.resize(tile.getArea());
+	for (size_t i = 0; i < pixels.size(); i++)
+		pixels[i] = toPixel(radiance[i]);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	queue.push_back({ tile, std::move(pixels) });
+	changed.notify_all();
+}
+
+void StreamingImageWriter::ioLoop() {
+	nameTraceThread("Image writer");
+	while (true) {
+		PendingTile pending;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this] { return !queue.empty() || finishing; });
+			if (queue.empty())
+				return;
+			pending = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		const Tile& tile = pending.tile;
+		{
+			TRACE_SCOPE("Write tile", "x", tile.x0, "y", tile.y0);
+			CounterScope counters(PHASE_OUTPUT);
+			std::streamsize rowBytes = tile.getWidth() * sizeof(Image::Pixel);
+			for (int y = tile.y0; y < tile.y1; y++) {
+				file.seekp(headerSize + ((std::streamoff)y * width + tile.x0) * sizeof(Image::Pixel));
+				file.write((const char*)&pending.pixels[(y - tile.y0) * tile.getWidth()], rowBytes);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		failed = failed || !file;
+		inFlight--;
+		freeBuffers.push_back(std::move(pending.pixels));
+		changed.notify_all();
+	}
+}
+
+void StreamingImageWriter::finish() {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return inFlight == 0; });
+	}
+	file.flush();
+	if (failed || !file)
+		throw "Could not write streamed image";
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Image.h"
+#include "LinearAlg.h"
+#include "Tile.h"
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Writes finished tiles straight into a binary ppm on disk from its own I/O thread while rendering carries on,
+//so no full frame ever sits in memory. The file is sized up front and each tile's rows are written in place,
+//at most maxTilesInFlight tonemapped tiles are buffered before write blocks the renderer
+struct StreamingImageWriter {
+private:
+	struct PendingTile {
+		Tile tile;
+		std::vector<Image::Pixel> pixels;
+	};
+
+	std::ofstream file;
+	std::streamoff headerSize;
+	int width;
+	int height;
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<PendingTile> queue;
+	std::vector<std::vector<Image::Pixel>> freeBuffers; //Recycled so steady state writing does not allocate
+	size_t maxTilesInFlight;
+	size_t inFlight = 0;
+	bool finishing = false;
+	bool failed = false;
+	std::thread ioThread;
+
+	void ioLoop();
+public:
+	StreamingImageWriter(const std::string& path, int width, int height, size_t maxTilesInFlight = 64);
+
+	StreamingImageWriter(const StreamingImageWriter&) = delete;
+
+	StreamingImageWriter& operator=(const StreamingImageWriter&) = delete;
+
+	~StreamingImageWriter();
+
+	//Tonemaps tile.getArea() row-major radiance values and queues them. Safe from any thread
+	void write(const Tile& tile, const Vec3f* radiance);
+
+	//Waits for everything queued to hit the disk, throws if anything failed to
+	void finish();
+};
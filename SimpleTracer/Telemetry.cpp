@@ -0,0 +1,133 @@
+#include "Telemetry.h"
+#include "Trace.h"
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif
+
+static std::atomic<uint64_t> tilesExpected{ 0 };
+static std::atomic<uint64_t> tilesDone{ 0 };
+static std::atomic<uint64_t> samplesDone{ 0 };
+static std::atomic<uint64_t> raysDone{ 0 };
+static std::atomic<int64_t> startNanos{ -1 }; //Of the first expectTiles
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+static int64_t nowNanos() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+static uint64_t residentBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#else
+	std::ifstream statm("/proc/self/statm"); //Sizes in pages, resident is the second
+	uint64_t size = 0, resident = 0;
+	if (!(statm >> size >> resident))
+		return 0;
+	return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+void expectTiles(size_t count) {
+	int64_t unset = -1;
+	startNanos.compare_exchange_strong(unset, nowNanos(), std::memory_order_relaxed);
+	tilesExpected.fetch_add(count, std::memory_order_relaxed);
+}
+
+void recordTileDone(uint64_t samples) {
+	tilesDone.fetch_add(1, std::memory_order_relaxed);
+	samplesDone.fetch_add(samples, std::memory_order_relaxed);
+}
+
+void recordRays(uint64_t count) {
+	raysDone.fetch_add(count, std::memory_order_relaxed);
+}
+
+uint64_t getRaysRecorded() {
+	return raysDone.load(std::memory_order_relaxed);
+}
+
+static void writeMetric(std::ostream& stream, const char* name, const char* type, const char* help, double value) {
+	stream << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n" << name << " " << value << "\n";
+}
+
+void writeMetrics(std::ostream& stream) {
+	uint64_t expected = tilesExpected.load(std::memory_order_relaxed);
+	uint64_t done = tilesDone.load(std::memory_order_relaxed);
+	uint64_t samples = samplesDone.load(std::memory_order_relaxed);
+	uint64_t rays = raysDone.load(std::memory_order_relaxed);
+	int64_t start = startNanos.load(std::memory_order_relaxed);
+	double elapsed = start >= 0 ? (nowNanos() - start) * 1e-9 : 0;
+	double remaining = done > 0 && expected > done ? elapsed / done * (expected - done) : 0;
+
+	stream.precision(17); //Counters are exact integers well past float precision
+	writeMetric(stream, "simpletracer_tiles_expected_total", "counter", "Tiles renders have set out to do", (double)expected);
+	writeMetric(stream, "simpletracer_tiles_done_total", "counter", "Tiles finished", (double)done);
+	writeMetric(stream, "simpletracer_samples_total", "counter", "Camera paths traced by finished tiles", (double)samples);
+	writeMetric(stream, "simpletracer_rays_total", "counter", "Intersection and shadow rays traced", (double)rays);
+	writeMetric(stream, "simpletracer_render_seconds", "gauge", "Time since the first tile was expected", elapsed);
+	writeMetric(stream, "simpletracer_samples_per_second", "gauge", "Average since the first tile was expected",
+		elapsed > 0 ? samples / elapsed : 0);
+	writeMetric(stream, "simpletracer_rays_per_second", "gauge", "Average since the first tile was expected",
+		elapsed > 0 ? rays / elapsed : 0);
+	writeMetric(stream, "simpletracer_eta_seconds", "gauge", "Estimated time left for the tiles expected so far", remaining);
+	writeMetric(stream, "process_resident_memory_bytes", "gauge", "Resident memory size in bytes", (double)residentBytes());
+}
+
+MetricsServer::MetricsServer(uint16_t port) :
+	listener(Socket::listen(port)),
+	port(listener.getPort()),
+	stopping(false),
+	thread(&MetricsServer::serve, this)
+{}
+
+MetricsServer::~MetricsServer() {
+	stopping = true;
+	Socket::connect("127.0.0.1", port); //Accept is blocking, so poke the listener to let serve see it should stop
+	thread.join();
+}
+
+void MetricsServer::serve() {
+	nameTraceThread("Metrics server");
+	while (true) {
+		Socket s = listener.accept();
+		if (stopping)
+			break;
+		if (!s.isValid())
+			continue;
+
+		//Only the request line matters, but the headers have to be read before answering or some clients give up
+		std::string request;
+		char buffer[1024];
+		while (request.find("\r\n\r\n") == std::string::npos && request.size() < 16 * 1024) {
+			int received = s.recvSome(buffer, sizeof(buffer));
+			if (received <= 0)
+				break;
+			request.append(buffer, received);
+		}
+
+		bool found = request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0;
+		std::ostringstream body;
+		if (found)
+			writeMetrics(body);
+		else
+			body << "Not found, try /metrics\n";
+		std::string content = body.str();
+		std::string response = std::string(found ? "HTTP/1.1 200 OK" : "HTTP/1.1 404 Not Found")
+			+ "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(content.size())
+			+ "\r\nConnection: close\r\n\r\n" + content;
+		s.sendAll(response.data(), response.size());
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Socket.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <thread>
+
+//Live progress of whatever this process is rendering, for farm monitoring to scrape. Render loops bump the counters
+//once per tile or path batch with relaxed atomic adds, which is nothing next to the thousands of rays in between.
+//Counters only grow over the process's lifetime, scrapers work out their own rates from them
+void expectTiles(size_t count);
+
+//A tile finished after tracing this many camera paths
+void recordTileDone(uint64_t samples);
+
+//Intersection and shadow rays, counted per path batch
+void recordRays(uint64_t count);
+
+//Every ray recordRays was told about so far
+uint64_t getRaysRecorded();
+
+//Counters plus average rates since the first tile was expected, estimated seconds left for the tiles expected so far
+//and resident memory, in Prometheus' text exposition format
+void writeMetrics(std::ostream& stream);
+
+//Answers HTTP requests for /metrics on 127.0.0.1:port with writeMetrics from its own thread, for as long as it lives.
+//One scrape at a time, scrapes are rare
+struct MetricsServer {
+private:
+	Socket listener;
+	uint16_t port;
+	std::atomic<bool> stopping;
+	std::thread thread;
+
+	void serve();
+public:
+	//Port 0 lets the OS pick a free port, see getPort
+	explicit MetricsServer(uint16_t port);
+
+	MetricsServer(const MetricsServer&) = delete;
+
+	MetricsServer& operator=(const MetricsServer&) = delete;
+
+	~MetricsServer();
+
+	uint16_t getPort() const {
+		return port;
+	}
+};
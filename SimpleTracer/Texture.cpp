@@ -0,0 +1,173 @@
+#include "Texture.h"
+#include "Film.h"
+#include <algorithm>
+#include <cmath>
+
+struct TextureFileHeader {
+	uint32_t magic;
+	uint32_t width;
+	uint32_t height;
+	uint32_t tileSize;
+	uint32_t numLevels;
+};
+
+void TextureTileCache::evict(Shard& shard) {
+	size_t shardCapacity = capacity / NUM_SHARDS;
+	while (shard.bytes > shardCapacity && shard.lru.size() > 1) { //Always keep the tile just loaded
+		Entry& victim = shard.lru.back();
+		shard.bytes -= tileBytes(*victim.tile);
+		shard.entries.erase(victim.key);
+		shard.lru.pop_back();
+	}
+}
+
+size_t TextureTileCache::getResidentBytes() {
+	size_t bytes = 0;
+	for (Shard& shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		bytes += shard.bytes;
+	}
+	return bytes;
+}
+
+TextureTileCache& getTextureCache() {
+	static TextureTileCache cache;
+	return cache;
+}
+
+static std::atomic<uint32_t> nextTextureId{ 0 };
+
+Texture::Texture(const std::string& path, TextureTileCache& cache) :
+	path(path),
+	id(nextTextureId++),
+	file(path, std::ifstream::binary),
+	cache(cache)
+{
+	TextureFileHeader header;
+	if (!file.read((char*)&header, sizeof(header)) || header.magic != MAGIC)
+		throw "Not a tiled texture file";
+
+	tileSize = header.tileSize;
+	uint64_t offset = sizeof(header);
+	int width = header.width;
+	int height = header.height;
+	for (uint32_t l = 0; l < header.numLevels; l++) {
+		int tilesX = (width + tileSize - 1) / tileSize;
+		int tilesY = (height + tileSize - 1) / tileSize;
+		levels.push_back({ width, height, tilesX, offset });
+		offset += (uint64_t)tilesX * tilesY * tileSize * tileSize * sizeof(Image::Pixel);
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+}
+
+void Texture::convert(const Image& img, const std::string& path, int tileSize) {
+	int width = (int)img.getWidth();
+	int height = (int)img.getHeight();
+	std::vector<Vec3f> level(width * height); //Filter in linear space, row-major
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++) {
+			Vec3f c = Vec3f(img(x, y)) / 255.0f;
+			level[y * width + x] = { c.x * c.x, c.y * c.y, c.z * c.z };
+		}
+
+	int numLevels = 1;
+	while ((width >> numLevels) > 0 || (height >> numLevels) > 0)
+		numLevels++;
+
+	std::ofstream out(path, std::ofstream::binary);
+	TextureFileHeader header{ MAGIC, (uint32_t)width, (uint32_t)height, (uint32_t)tileSize, (uint32_t)numLevels };
+	out.write((const char*)&header, sizeof(header));
+
+	TextureTile tile(tileSize * tileSize);
+	for (int l = 0; l < numLevels; l++) {
+		for (int ty = 0; ty * tileSize < height; ty++) {
+			for (int tx = 0; tx * tileSize < width; tx++) {
+				for (int y = 0; y < tileSize; y++) {
+					for (int x = 0; x < tileSize; x++) { //Edge tiles get padded with the last texel
+						int sx = std::min(tx * tileSize + x, width - 1);
+						int sy = std::min(ty * tileSize + y, height - 1);
+						tile[y * tileSize + x] = toPixel(level[sy * width + sx]);
+					}
+				}
+				out.write((const char*)tile.data(), tile.size() * sizeof(Image::Pixel));
+			}
+		}
+
+		int nextWidth = std::max(width / 2, 1);
+		int nextHeight = std::max(height / 2, 1);
+		std::vector<Vec3f> next(nextWidth * nextHeight);
+		for (int y = 0; y < nextHeight; y++) {
+			for (int x = 0; x < nextWidth; x++) { //2x2 box, clamped for odd and 1 texel wide levels
+				int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+				int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+				next[y * nextWidth + x] = (level[y0 * width + x0] + level[y0 * width + x1] + level[y1 * width + x0] + level[y1 * width + x1]) * 0.25f;
+			}
+		}
+		level.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+	}
+	if (!out)
+		throw "Could not write tiled texture";
+}
+
+TextureTile Texture::loadTile(int level, int tx, int ty) {
+	TextureTile tile(tileSize * tileSize);
+	uint64_t offset = levels[level].offset + ((uint64_t)ty * levels[level].tilesX + tx) * tile.size() * sizeof(Image::Pixel);
+	std::lock_guard<std::mutex> lock(fileMutex);
+	file.seekg(offset);
+	file.read((char*)tile.data(), tile.size() * sizeof(Image::Pixel));
+	if (!file)
+		throw "Tiled texture file is truncated";
+	return tile;
+}
+
+std::shared_ptr<const TextureTile> Texture::getTile(int level, int tx, int ty) {
+	uint64_t key = ((uint64_t)id << 48) | ((uint64_t)level << 42) | ((uint64_t)ty << 21) | (uint64_t)tx;
+	return cache.get(key, [&] { return loadTile(level, tx, ty); });
+}
+
+Vec3f Texture::bilerp(int level, Poi2f uv) {
+	const Level& lvl = levels[level];
+	float x = (uv.x - std::floor(uv.x)) * lvl.width - 0.5f; //Repeat wrapping
+	float y = (uv.y - std::floor(uv.y)) * lvl.height - 0.5f;
+	int x0 = (int)std::floor(x);
+	int y0 = (int)std::floor(y);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	//The 4 texels nearly always share a tile, so only go back to the cache when they don't
+	std::shared_ptr<const TextureTile> tile;
+	int tileX = -1, tileY = -1;
+	auto texel = [&](int tx, int ty) {
+		tx = (tx % lvl.width + lvl.width) % lvl.width;
+		ty = (ty % lvl.height + lvl.height) % lvl.height;
+		if (tx / tileSize != tileX || ty / tileSize != tileY) {
+			tileX = tx / tileSize;
+			tileY = ty / tileSize;
+			tile = getTile(level, tileX, tileY);
+		}
+		Vec3f c = Vec3f((*tile)[(ty % tileSize) * tileSize + tx % tileSize]) / 255.0f;
+		return Vec3f{ c.x * c.x, c.y * c.y, c.z * c.z };
+	};
+
+	return (1 - fy) * ((1 - fx) * texel(x0, y0) + fx * texel(x0 + 1, y0))
+		+ fy * ((1 - fx) * texel(x0, y0 + 1) + fx * texel(x0 + 1, y0 + 1));
+}
+
+Vec3f Texture::lookup(Poi2f uv, float texelFootprint) {
+	float level = std::log2(std::max(texelFootprint, 1.0f));
+	int l0 = std::min((int)level, getNumLevels() - 1);
+	if (l0 == getNumLevels() - 1)
+		return bilerp(l0, uv);
+	float t = level - l0;
+	return (1 - t) * bilerp(l0, uv) + t * bilerp(l0 + 1, uv);
+}
+
+Vec3f Texture::lookup(Poi2f uv, float width, const Vec3f& dpdu, const Vec3f& dpdv) {
+	//World space width over how far a unit of u or v moves the point gives the width in uv, then in texels
+	float du = dpdu.length() > 0 ? width / dpdu.length() : 0;
+	float dv = dpdv.length() > 0 ? width / dpdv.length() : 0;
+	return lookup(uv, std::max(du * getWidth(), dv * getHeight()));
+}
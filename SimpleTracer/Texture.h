@@ -0,0 +1,159 @@
+#pragma once
+
+#include "Image.h"
+#include "LinearAlg.h"
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Fixed size block of texels that the cache loads and evicts as a unit
+using TextureTile = std::vector<Image::Pixel>;
+
+//Thread safe LRU cache of texture tiles with a hard cap on the bytes it keeps resident.
+//Split into shards with their own lock so threads looking up different tiles rarely wait on each other
+struct TextureTileCache {
+private:
+	static constexpr size_t NUM_SHARDS = 16;
+
+	struct Entry {
+		uint64_t key;
+		std::shared_ptr<const TextureTile> tile;
+	};
+
+	struct Shard {
+		std::mutex mutex;
+		std::list<Entry> lru; //Most recently used first
+		std::unordered_map<uint64_t, std::list<Entry>::iterator> entries;
+		size_t bytes = 0;
+	};
+
+	Shard shards[NUM_SHARDS];
+	std::atomic<size_t> capacity;
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> misses;
+
+	static size_t tileBytes(const TextureTile& tile) {
+		return tile.size() * sizeof(Image::Pixel) + sizeof(Entry);
+	}
+
+	void evict(Shard& shard);
+public:
+	static constexpr size_t DEFAULT_CAPACITY = 256 << 20;
+
+	explicit TextureTileCache(size_t capacity = DEFAULT_CAPACITY) :
+		capacity(capacity),
+		hits(0),
+		misses(0)
+	{}
+
+	size_t getCapacity() const {
+		return capacity;
+	}
+
+	//Shrinking evicts lazily, on the next insert into each shard
+	void setCapacity(size_t bytes) {
+		capacity = bytes;
+	}
+
+	uint64_t getHits() const {
+		return hits;
+	}
+
+	uint64_t getMisses() const {
+		return misses;
+	}
+
+	size_t getResidentBytes();
+
+	//Returns the cached tile for key or calls load() to read it in, possibly evicting others.
+	//The returned tile stays valid while held even if it gets evicted meanwhile
+	template<typename Load>
+	std::shared_ptr<const TextureTile> get(uint64_t key, const Load& load) {
+		Shard& shard = shards[(key ^ (key >> 29)) % NUM_SHARDS];
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto found = shard.entries.find(key);
+			if (found != shard.entries.end()) {
+				shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+				hits++;
+				return found->second->tile;
+			}
+		}
+
+		//Load outside the lock, two threads racing for one tile just both read it
+		misses++;
+		std::shared_ptr<const TextureTile> tile = std::make_shared<const TextureTile>(load());
+
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto found = shard.entries.find(key);
+		if (found != shard.entries.end())
+			return found->second->tile;
+		shard.lru.push_front({ key, tile });
+		shard.entries[key] = shard.lru.begin();
+		shard.bytes += tileBytes(*tile);
+		evict(shard);
+		return tile;
+	}
+};
+
+//Cache shared by every texture in the process
+TextureTileCache& getTextureCache();
+
+//Mip-mapped texture kept on disk as fixed size tiles and paged in through the tile cache, so only
+//the tiles and levels actually looked at ever sit in memory. Texels are stored gamma 2 encoded like our output
+struct Texture {
+private:
+	struct Level {
+		int width;
+		int height;
+		int tilesX;
+		uint64_t offset; //Byte offset of the level's first tile in the file
+	};
+
+	std::string path;
+	uint32_t id;
+	int tileSize;
+	std::vector<Level> levels;
+	std::ifstream file;
+	std::mutex fileMutex;
+	TextureTileCache& cache;
+
+	TextureTile loadTile(int level, int tx, int ty);
+
+	std::shared_ptr<const TextureTile> getTile(int level, int tx, int ty);
+
+	Vec3f bilerp(int level, Poi2f uv);
+public:
+	static constexpr uint32_t MAGIC = 0x58545453; //"STTX"
+	static constexpr int DEFAULT_TILE_SIZE = 64;
+
+	//Opens a texture written by convert
+	explicit Texture(const std::string& path, TextureTileCache& cache = getTextureCache());
+
+	//Builds the mip chain of img with a box filter and writes it tiled to path
+	static void convert(const Image& img, const std::string& path, int tileSize = DEFAULT_TILE_SIZE);
+
+	int getWidth() const {
+		return levels[0].width;
+	}
+
+	int getHeight() const {
+		return levels[0].height;
+	}
+
+	int getNumLevels() const {
+		return (int)levels.size();
+	}
+
+	//Trilinear lookup of linear color. texelFootprint is the lookup width in level 0 texels, it picks the mip level
+	Vec3f lookup(Poi2f uv, float texelFootprint);
+
+	//Lookup for a surface point whose footprint is width wide in world space, with the partials of position by uv
+	Vec3f lookup(Poi2f uv, float width, const Vec3f& dpdu, const Vec3f& dpdv);
+};
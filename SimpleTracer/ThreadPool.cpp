@@ -0,0 +1,118 @@
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+bool pinCurrentThread(int cpu) {
+#ifdef _WIN32
+	GROUP_AFFINITY affinity{};
+	affinity.Group = (WORD)(cpu / 64);
+	affinity.Mask = (KAFFINITY)1 << (cpu % 64);
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+ThreadPool::ThreadPool(size_t numThreads) :
+	job{ 0, nullptr, nullptr, false },
+	next(0)
+{
+	numThreads = std::max<size_t>(numThreads, 1);
+	for (size_t i = 1; i < numThreads; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::ThreadPool(const std::vector<int>& threadCpus) :
+	job{ 0, nullptr, nullptr, false },
+	next(0)
+{
+	if (!threadCpus.empty())
+		pinCurrentThread(threadCpus[0]);
+	for (size_t i = 1; i < threadCpus.size(); i++) {
+		int cpu = threadCpus[i];
+		workers.emplace_back([this, i, cpu] {
+			pinCurrentThread(cpu);
+			workerLoop(i);
+		});
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	wake.notify_all();
+	for (std::thread& t : workers)
+		t.join();
+}
+
+void ThreadPool::work(size_t threadIndex) {
+	if (job.perThread) {
+		job.invoke(job.func, threadIndex, threadIndex);
+		return;
+	}
+	size_t i;
+	while ((i = next.fetch_add(1, std::memory_order_relaxed)) < job.count)
+		job.invoke(job.func, i, threadIndex);
+}
+
+void ThreadPool::workerLoop(size_t threadIndex) {
+	nameTraceThread("Worker " + std::to_string(threadIndex));
+	size_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return generation != seen || quitting; });
+			if (quitting)
+				return;
+			seen = generation;
+		}
+
+		work(threadIndex);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyWorkers == 0)
+			done.notify_one();
+	}
+}
+
+void ThreadPool::run(size_t count, Invoker invoke, const void* func, bool perThread) {
+	std::lock_guard<std::mutex> dispatch(dispatchMutex);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = { count, invoke, func, perThread };
+		next.store(0, std::memory_order_relaxed);
+		busyWorkers = workers.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	work(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return busyWorkers == 0; });
+}
+
+static size_t poolSize = 0; //0 for the machine's
+
+void setThreadPoolSize(size_t numThreads) {
+	poolSize = numThreads;
+}
+
+ThreadPool& getThreadPool() {
+	static ThreadPool pool(poolSize > 0 ? poolSize : std::thread::hardware_concurrency());
+	return pool;
+}
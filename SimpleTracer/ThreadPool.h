@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Fixed set of worker threads that split index ranges between them.
+//Dispatching a job does not allocate, so it is safe to use inside render loops
+struct ThreadPool {
+private:
+	using Invoker = void(*)(const void* func, size_t index, size_t threadIndex);
+
+	struct Job {
+		size_t count;
+		Invoker invoke;
+		const void* func;
+		bool perThread; //Every thread makes exactly one call instead of splitting indices
+	};
+
+	std::vector<std::thread> workers;
+	std::mutex dispatchMutex; //Only one parallelFor runs at a time
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	Job job;
+	std::atomic<size_t> next;
+	size_t generation = 0;
+	size_t busyWorkers = 0;
+	bool quitting = false;
+
+	void work(size_t threadIndex);
+
+	void workerLoop(size_t threadIndex);
+
+	void run(size_t count, Invoker invoke, const void* func, bool perThread);
+public:
+	//numThreads counts the calling thread, which always helps with the work
+	explicit ThreadPool(size_t numThreads = std::thread::hardware_concurrency());
+
+	//One thread per entry, pinned to that cpu. The constructing thread becomes thread 0 and gets
+	//pinned to threadCpus[0], so jobs should be dispatched from it
+	explicit ThreadPool(const std::vector<int>& threadCpus);
+
+	ThreadPool(const ThreadPool&) = delete;
+
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool();
+
+	size_t getNumThreads() const {
+		return workers.size() + 1;
+	}
+
+	//Calls func(index, threadIndex) for every index in [0, count) and returns once all calls have.
+	//threadIndex is in [0, getNumThreads()) and unique among concurrent calls. Not reentrant
+	template<typename F>
+	void parallelFor(size_t count, const F& func) {
+		run(count, [](const void* f, size_t index, size_t threadIndex) {
+			(*(const F*)f)(index, threadIndex);
+		}, &func, false);
+	}
+
+	//Calls func(threadIndex) exactly once on every thread of the pool, e.g. to first touch per-thread memory
+	template<typename F>
+	void forEachThread(const F& func) {
+		run(getNumThreads(), [](const void* f, size_t, size_t threadIndex) {
+			(*(const F*)f)(threadIndex);
+		}, &func, true);
+	}
+};
+
+//Binds the calling thread to one logical cpu, returns false if the OS refused
+bool pinCurrentThread(int cpu);
+
+//Sizes the process wide pool instead of the machine, e.g. to run several threads on a one cpu box. Only takes effect
+//before the pool's first use
+void setThreadPoolSize(size_t numThreads);
+
+//Process wide pool sized to the machine, or to setThreadPoolSize
+ThreadPool& getThreadPool();
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "LinearAlg.h"
+#include <vector>
+#include <algorithm>
+
+static constexpr int TILE_SIZE = 32;
+
+struct Tile {
+	//Top left corner is inclusive, bottom right is exclusive
+	int x0, y0;
+	int x1, y1;
+
+	int getWidth() const {
+		return x1 - x0;
+	}
+
+	int getHeight() const {
+		return y1 - y0;
+	}
+
+	int getArea() const {
+		return getWidth() * getHeight();
+	}
+
+	bool operator==(const Tile& other) const {
+		return x0 == other.x0 && y0 == other.y0 && x1 == other.x1 && y1 == other.y1;
+	}
+};
+
+//Splits the image into row-major tiles, the ones along the right and bottom edges get clipped
+inline void appendTiles(Vec2i resolution, int tileSize, std::vector<Tile>& tiles) {
+	for (int y = 0; y < resolution.y; y += tileSize) {
+		for (int x = 0; x < resolution.x; x += tileSize) {
+			tiles.push_back({ x, y, std::min(x + tileSize, resolution.x), std::min(y + tileSize, resolution.y) });
+		}
+	}
+}
+
+inline std::vector<Tile> makeTiles(Vec2i resolution, int tileSize = TILE_SIZE) {
+	std::vector<Tile> tiles;
+	appendTiles(resolution, tileSize, tiles);
+	return tiles;
+}
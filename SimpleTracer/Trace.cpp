@@ -0,0 +1,111 @@
+#include "Trace.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent {
+	const char* name;
+	int64_t start;
+	int64_t end;
+	const char* argNames[2];
+	int64_t args[2];
+};
+
+//One per thread that ever recorded, owned by the registry so events outlive the thread
+struct ThreadBuffer {
+	size_t tid;
+	std::string name;
+	std::vector<TraceEvent> events;
+};
+
+static std::atomic<bool> tracingEnabled{ false };
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> registry;
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+//Registers the calling thread's buffer on first use, the only time recording locks
+static ThreadBuffer& getThreadBuffer() {
+	thread_local ThreadBuffer* buffer = nullptr;
+	if (buffer == nullptr) {
+		std::lock_guard<std::mutex> lock(registryMutex);
+		registry.push_back(std::make_unique<ThreadBuffer>());
+		buffer = registry.back().get();
+		buffer->tid = registry.size();
+		buffer->name = "Thread " + std::to_string(buffer->tid);
+		buffer->events.reserve(4096);
+	}
+	return *buffer;
+}
+
+static void writeEscaped(std::ostream& stream, const std::string& text) {
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			stream << '\\';
+		stream << c;
+	}
+}
+
+bool isTracing() {
+	return tracingEnabled.load(std::memory_order_relaxed);
+}
+
+void setTracing(bool enabled) {
+	tracingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void nameTraceThread(const std::string& name) {
+	getThreadBuffer().name = name;
+}
+
+void recordTraceEvent(const char* name, int64_t startNanos, int64_t endNanos, const char* const argNames[2], const int64_t args[2]) {
+	getThreadBuffer().events.push_back({ name, startNanos, endNanos, { argNames[0], argNames[1] }, { args[0], args[1] } });
+}
+
+int64_t traceNowNanos() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+//Complete ("X") events in microseconds, plus a thread_name metadata event per thread
+void writeTrace(std::ostream& stream) {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	for (const std::unique_ptr<ThreadBuffer>& buffer : registry) {
+		stream << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"";
+		writeEscaped(stream, buffer->name);
+		stream << "\"}}";
+		first = false;
+		for (const TraceEvent& e : buffer->events) {
+			stream << ",\n{\"name\":\"";
+			writeEscaped(stream, e.name);
+			stream << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":" << e.start / 1000 << "." << e.start % 1000 / 100
+				<< ",\"dur\":" << (e.end - e.start) / 1000 << "." << (e.end - e.start) % 1000 / 100;
+			if (e.argNames[0] != nullptr) {
+				stream << ",\"args\":{\"" << e.argNames[0] << "\":" << e.args[0];
+				if (e.argNames[1] != nullptr)
+					stream << ",\"" << e.argNames[1] << "\":" << e.args[1];
+				stream << "}";
+			}
+			stream << "}";
+		}
+	}
+	stream << "\n]}\n";
+}
+
+TraceSession::TraceSession(const std::string& path) :
+	path(path)
+{
+	if (!path.empty())
+		setTracing(true);
+}
+
+TraceSession::~TraceSession() {
+	if (path.empty())
+		return;
+	setTracing(false);
+	std::ofstream file(path);
+	writeTrace(file);
+}
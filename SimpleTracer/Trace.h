@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+//Timeline of what every thread was doing, written as Chrome trace event JSON for chrome://tracing or ui.perfetto.dev.
+//Each thread appends to its own buffer, so recording takes no locks past a thread's first event. Off until enabled,
+//when a scope costs one flag check
+bool isTracing();
+
+void setTracing(bool enabled);
+
+//Shows in the viewer instead of the thread's number
+void nameTraceThread(const std::string& name);
+
+//Appends a finished span to the calling thread's buffer. name and argument names must outlive the trace
+void recordTraceEvent(const char* name, int64_t startNanos, int64_t endNanos, const char* const argNames[2], const int64_t args[2]);
+
+int64_t traceNowNanos();
+
+//Every event recorded so far. Threads should be done recording, e.g. once a render returned
+void writeTrace(std::ostream& stream);
+
+//Records the time from construction to destruction as one span, with up to two integer arguments shown beside it
+struct TraceScope {
+private:
+	const char* name;
+	const char* argNames[2];
+	int64_t args[2];
+	int64_t start;
+public:
+	TraceScope(const char* name, const char* argName0 = nullptr, int64_t arg0 = 0, const char* argName1 = nullptr, int64_t arg1 = 0) :
+		name(name),
+		argNames{ argName0, argName1 },
+		args{ arg0, arg1 },
+		start(isTracing() ? traceNowNanos() : -1)
+	{}
+
+	TraceScope(const TraceScope&) = delete;
+
+	TraceScope& operator=(const TraceScope&) = delete;
+
+	~TraceScope() {
+		if (start >= 0)
+			recordTraceEvent(name, start, traceNowNanos(), argNames, args);
+	}
+};
+
+//Enables tracing for its lifetime and writes everything recorded to path when it ends. An empty path does nothing
+struct TraceSession {
+private:
+	std::string path;
+public:
+	explicit TraceSession(const std::string& path);
+
+	TraceSession(const TraceSession&) = delete;
+
+	TraceSession& operator=(const TraceSession&) = delete;
+
+	~TraceSession();
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+//TRACE_SCOPE("Name") or TRACE_SCOPE("Name", "arg", value[, "arg", value]) spans the rest of the enclosing block
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
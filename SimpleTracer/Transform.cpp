@@ -84,20 +84,32 @@ Vec4f Transform::getTranslation() const {
 	return Vec4f(m.pull<4, 1>(3, 0));
 }
 
+float Transform::uniformScale() const {
+	Vec3f axes[3] = { operator()(Vec3f{ 1, 0, 0 }), operator()(Vec3f{ 0, 1, 0 }), operator()(Vec3f{ 0, 0, 1 }) };
+	float scale = axes[0].length();
+	for (int i = 0; i < 3; i++) {
+		const Vec3f& next = axes[(i + 1) % 3];
+		if (std::abs(axes[i].length() - scale) > 1e-4f * scale || std::abs(dot(axes[i], next)) > 1e-4f * scale * scale)
+			return 0;
+	}
+	return scale;
+}
+
 Ray Transform::operator()(const Ray& ray) const {
 	if (*this == I)
 		return ray;
-	Ray r{ operator()(ray.org), operator()(ray.dir) };
-	float dir1 = r.dir.length();
-	float dir2 = ray.dir.length();
-	float k = 0;
-	if (dir1 == 0 || dir2 == 0)
-		k = 1;
-	else {
-		k = r.dir.length() / ray.dir.length();
-	}
-	r.tMin = ray.tMin * k;
-	r.tMax = ray.tMax * k;
+	return operator()(ray, operator()(ray.org));
+}
+
+Ray Transform::operator()(const Ray& ray, const Poi3f& org) const {
+	if (*this == I)
+		return ray;
+	Ray r{ org, operator()(ray.dir) };
+	//The direction is transformed unnormalized, so org + t * dir maps to the same t on either side and the range carries over
+	r.tMin = ray.tMin;
+	r.tMax = ray.tMax;
+	r.coneWidth = ray.coneWidth;
+	r.coneSpread = ray.coneSpread;
 	return r;
 }
 
@@ -113,6 +125,17 @@ Intersection Transform::operator()(const Intersection& insect) const {
 	return i;
 }
 
+Bounds3f Transform::operator()(const Bounds3f& bounds) const { //Box around all 8 transformed corners
+	if (*this == I)
+		return bounds;
+	Bounds3f b;
+	for (int corner = 0; corner < 8; corner++) {
+		Poi3f p{ (corner & 1) ? bounds.max.x : bounds.min.x, (corner & 2) ? bounds.max.y : bounds.min.y, (corner & 4) ? bounds.max.z : bounds.min.z };
+		b = merge(b, operator()(p));
+	}
+	return b;
+}
+
 Transform inv(const Transform& trans) {
 	if (trans == I)
 		return trans;
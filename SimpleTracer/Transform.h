@@ -3,6 +3,7 @@
 #include "LinearAlg.h"
 #include "Intersection.h"
 #include "Ray.h"
+#include "Bounds.h"
 
 struct Transform {
 private:
@@ -47,11 +48,19 @@ public:
 
 	Vec4f getTranslation() const;
 
+	//How much every length grows, 0 when lengths along different directions grow differently, e.g. under a shear
+	float uniformScale() const;
+
 	Ray operator()(const Ray& ray) const;
 
+	//Same, for a ray whose origin was already transformed into org, e.g. one shared by many rays
+	Ray operator()(const Ray& ray, const Poi3f& org) const;
+
 	friend Transform inv(const Transform& trans);
 
 	Intersection operator()(const Intersection& insect) const;
 
+	Bounds3f operator()(const Bounds3f& bounds) const;
+
 	friend bool operator==(const Transform& lhs, const Transform& rhs);
 };
\ No newline at end of file
@@ -25,30 +25,102 @@ struct Triangle : public Shape {
 		this->hasVertNorms = hasVertNorms;
 	}
 
-	virtual bool intersect(const Ray& r, Intersection* insect = nullptr) const {
-		Mat33f matrix = Mat33f();
-		matrix.put(0, 0, asRowMatrix(*pB - *pA));
-		matrix.put(1, 0, asRowMatrix(*pC - *pA));
-		matrix.put(2, 0, asRowMatrix(r.dir));
-		Vec3f uvt = inv(matrix) * (r.org - *pA);
-		Poi2f uv{ uvt.x, uvt.y }; //Localize to Triangle
-		float t = uvt.z;
-		bool hitSurface = uv.x >= 0 && uv.y >= 0 && uv.x + uv.y <= 1;
-		if (t > r.tMax || t < r.tMin || !hitSurface) //Intesection either to close or to far, or didn't even hit
+	virtual Bounds3f objectBound() const {
+		return merge(Bounds3f(*pA, *pB), *pC);
+	}
+
+	//Still points into the mesh's vertex arrays, only meshes own geometry
+	virtual Shape* clone(Arena& arena) const {
+		return arena.create<Triangle>(*this);
+	}
+
+	virtual float area() const {
+		return 0.5f * cross(*pB - *pA, *pC - *pA).length();
+	}
+
+	//Uniform by area, converted to solid angle at ref
+	virtual float sample(const Poi3f& ref, const Poi2f& u, Poi3f& p, Norm3f& n) const {
+		float su = std::sqrt(u[0]);
+		float b0 = 1 - su;
+		float b1 = u[1] * su;
+		p = *pA + b1 * (*pB - *pA) + (1 - b0 - b1) * (*pC - *pA);
+		Vec3f normal = normalize(cross(*pB - *pA, *pC - *pA));
+		n = Norm3f(normal);
+		Vec3f wi = p - ref;
+		float dist2 = wi.lengthSq();
+		float cosLight = std::abs(dot(normal, wi)) / std::sqrt(dist2);
+		return dist2 > 0 && cosLight > 0 ? dist2 / (cosLight * area()) : 0;
+	}
+
+	virtual DirectionCone normalBounds() const {
+		return { normalize(cross(*pB - *pA, *pC - *pA)), 1 };
+	}
+
+	//Moller-Trumbore: where r crosses the plane, as the ray parameter and the weights of pB and pC. False if it misses
+	bool solve(const Ray& r, float& t, Poi2f& b) const {
+		Vec3f e1 = *pB - *pA;
+		Vec3f e2 = *pC - *pA;
+		Vec3f p = cross(r.dir, e2);
+		float det = dot(e1, p);
+		if (det == 0) //Parallel to the plane
+			return false;
+		float invDet = 1 / det;
+		Vec3f s = r.org - *pA;
+		b.x = dot(s, p) * invDet;
+		if (b.x < 0 || b.x > 1)
+			return false;
+		Vec3f q = cross(s, e1);
+		b.y = dot(r.dir, q) * invDet;
+		if (b.y < 0 || b.x + b.y > 1)
+			return false;
+		t = dot(e2, q) * invDet;
+		return t >= r.tMin && t <= r.tMax;
+	}
+
+	using Shape::intersect;
+
+	virtual bool intersect(const Ray& r, Hit& hit) const {
+		float t;
+		Poi2f b;
+		if (!solve(r, t, b))
 			return false;
 		r.tMax = t;
 
-		if (insect != nullptr) {
-			insect->p = r(t);
-			if (hasVertNorms) {
-				insect->n = normalize(*nA + uv.x * (*nB - *nA) + uv.y * (*nC - *nA)); //Does this work?... maybe have seperate normals for shading anyways
-			} else {
-				insect->n = Norm3f(normalize(cross(*pB - *pA, *pC - *pA)));
-			}
-			insect->uv = *uvA + uv.x * (*uvB - *uvA) + uv.y * (*uvC - *uvA); //Transforms localized UVs to be relative to mesh
+		hit.t = t;
+		hit.primId = 0;
+		hit.b = b;
+		return true;
+	}
+
+	virtual bool occluded(const Ray& r) const {
+		float t;
+		Poi2f b;
+		return solve(r, t, b);
+	}
+
+	virtual void finalize(const Ray& r, const Hit& hit, Intersection& insect) const {
+		Poi2f uv = hit.b;
+		insect.wo = -r.dir;
+		insect.p = r(hit.t);
+		if (hasVertNorms) {
+			insect.n = normalize(*nA + uv.x * (*nB - *nA) + uv.y * (*nC - *nA)); //Does this work?... maybe have seperate normals for shading anyways
+		} else {
+			insect.n = Norm3f(normalize(cross(*pB - *pA, *pC - *pA)));
 		}
+		insect.uv = *uvA + uv.x * (*uvB - *uvA) + uv.y * (*uvC - *uvA); //Transforms localized UVs to be relative to mesh
 
-		return true;
+		//Solves the edges for how position changes with uv. Meshes without uvs leave every vertex at 0, then there is none
+		Vec2f duvB = *uvB - *uvA;
+		Vec2f duvC = *uvC - *uvA;
+		Vec3f dpB = *pB - *pA;
+		Vec3f dpC = *pC - *pA;
+		float det = duvB.x * duvC.y - duvB.y * duvC.x;
+		if (std::abs(det) < 1e-8f) {
+			insect.dpdu = insect.dpdv = Vec3f{ 0, 0, 0 };
+		} else {
+			insect.dpdu = (duvC.y * dpB - duvB.y * dpC) / det;
+			insect.dpdv = (duvB.x * dpC - duvC.x * dpB) / det;
+		}
 	}
 
 	virtual ~Triangle() {
@@ -4,6 +4,9 @@
 #include "Shape.h"
 #include "LinearAlg.h"
 #include "Triangle.h"
+#include "Arena.h"
+#include "BVH.h"
+#include <vector>
 
 class TriangleMesh : public Shape {
 private:
@@ -15,6 +18,8 @@ private:
 	
 	int numTris;
 	int* vertIndexes;
+
+	BVH bvh; //Over the triangles, in object space
 	
 private:
 	void getVertIndexes(int triIndex, int& a, int& b, int& c) const {
@@ -23,32 +28,111 @@ private:
 		c = vertIndexes[3 * triIndex + 2];
 	}
 
+	Triangle getTriangle(int triIndex) const {
+		int iA, iB, iC;
+		getVertIndexes(triIndex, iA, iB, iC);
+		return Triangle{ iA, iB, iC, verts, vertUvs, vertNorms, hasVertNorms };
+	}
+
 public:
 	TriangleMesh() {
 
 	}
 
-	virtual bool intersect(const Ray& ray, Intersection* insect = nullptr) const {
+	//Copies the geometry into arrays of arena, which must be the one the mesh itself lives in. Every 3 indexes make a triangle
+	TriangleMesh(Arena& arena, const Poi3f* positions, int numVerts, const int* indexes, int numTris) :
+		numVerts(numVerts),
+		verts(arena.createArray<Poi3f>(numVerts)),
+		vertUvs(arena.createArray<Poi2f>(numVerts)),
+		hasVertNorms(false),
+		vertNorms(nullptr),
+		numTris(numTris),
+		vertIndexes(arena.createArray<int>(3 * numTris))
+	{
 		if (numTris < 1)
 			throw "Fewer than 1 triangle";
-		int closestIndex = 0;
+		std::copy(positions, positions + numVerts, verts);
+		for (int i = 0; i < 3 * numTris; i++) {
+			if (indexes[i] < 0 || indexes[i] >= numVerts)
+				throw "Triangle index out of range";
+			vertIndexes[i] = indexes[i];
+		}
+		std::vector<Bounds3f> triBounds(numTris);
+		for (int triIndex = 0; triIndex < numTris; triIndex++)
+			triBounds[triIndex] = getTriangle(triIndex).objectBound();
+		bvh.build(triBounds);
+	}
 
-		bool hit = true;
-		for (int triIndex = 0; triIndex < numTris; triIndex++) {
-			int iA, iB, iC;
-			getVertIndexes(triIndex, iA, iB, iC);
-			Triangle tri{ iA, iB, iC, verts, vertUvs, vertNorms, hasVertNorms };
+	virtual Bounds3f objectBound() const {
+		Bounds3f b;
+		for (int i = 0; i < numVerts; i++)
+			b = merge(b, verts[i]);
+		return b;
+	}
 
-			hit = hit || tri.intersect(ray, insect);
+	//Geometry is copied into arena arrays, so it goes with the arena
+	virtual Shape* clone(Arena& arena) const {
+		TriangleMesh* mesh = arena.create<TriangleMesh>();
+		mesh->numVerts = numVerts;
+		mesh->verts = arena.createArray<Poi3f>(numVerts);
+		mesh->vertUvs = arena.createArray<Poi2f>(numVerts);
+		std::copy(verts, verts + numVerts, mesh->verts);
+		std::copy(vertUvs, vertUvs + numVerts, mesh->vertUvs);
+		mesh->hasVertNorms = hasVertNorms;
+		mesh->vertNorms = nullptr;
+		if (hasVertNorms) {
+			mesh->vertNorms = arena.createArray<Norm3f>(numVerts);
+			std::copy(vertNorms, vertNorms + numVerts, mesh->vertNorms);
 		}
-		return hit;
+		mesh->numTris = numTris;
+		mesh->vertIndexes = arena.createArray<int>(3 * numTris);
+		std::copy(vertIndexes, vertIndexes + 3 * numTris, mesh->vertIndexes);
+		mesh->bvh = bvh;
+		return mesh;
+	}
+
+	using Shape::intersect;
+
+	virtual bool intersect(const Ray& ray, Hit& hit) const {
+		if (numTris < 1)
+			throw "Fewer than 1 triangle";
+
+		return bvh.intersect(ray, [&](uint32_t triIndex) {
+			if (!getTriangle(triIndex).intersect(ray, hit))
+				return false;
+			hit.primId = triIndex;
+			return true;
+		});
+	}
+
+	virtual bool occluded(const Ray& ray) const {
+		return bvh.occluded(ray, [&](uint32_t triIndex) {
+			return getTriangle(triIndex).occluded(ray);
+		});
+	}
+
+	virtual void finalize(const Ray& ray, const Hit& hit, Intersection& insect) const {
+		getTriangle(hit.primId).finalize(ray, hit, insect);
+	}
+
+	//Every triangle is a light piece of its own, so the light hierarchy can tell near ones from far ones
+	virtual uint32_t numLightPieces() const {
+		return (uint32_t)numTris;
+	}
+
+	virtual Bounds3f pieceBound(uint32_t piece) const {
+		return getTriangle(piece).objectBound();
+	}
+
+	virtual float pieceArea(uint32_t piece) const {
+		return getTriangle(piece).area();
+	}
+
+	virtual float samplePiece(uint32_t piece, const Poi3f& ref, const Poi2f& u, Poi3f& p, Norm3f& n) const {
+		return getTriangle(piece).sample(ref, u, p, n);
 	}
 
-	~TriangleMesh() {
-		delete[] verts, vertUvs, vertNorms, vertIndexes;
-		verts = nullptr;
-		vertUvs = nullptr;
-		vertNorms = nullptr;
-		vertIndexes = nullptr;
+	virtual DirectionCone pieceNormalBounds(uint32_t piece) const {
+		return getTriangle(piece).normalBounds();
 	}
 };
\ No newline at end of file